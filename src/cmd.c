@@ -41,6 +41,7 @@
 #include "parse.h"
 #include "event.h"
 #include "layout.h"
+#include "perf.h"
 
 
 int adjustisetting(int i, int rel, int *val, int other, int border)
@@ -112,7 +113,8 @@ int adjustwsormon(char **argv)
 				;
 			ws = m ? m->ws : selws;
 		} else if (opt == DIR_PREV) {
-			FIND_PREV(ws, cur, workspaces);
+			if (!(ws = cur->prev))
+				FIND_TAIL(ws, workspaces);
 		} else {
 			int r = 0;
 			Workspace *save = cur;
@@ -129,8 +131,8 @@ int adjustwsormon(char **argv)
 							&& nextmon(m->next) != cm; m = nextmon(m->next))
 						;
 					ws = m ? m->ws : selws;
-				} else {
-					FIND_PREV(ws, cur, workspaces);
+				} else if (!(ws = cur->prev)) {
+					FIND_TAIL(ws, workspaces);
 				}
 				cur = ws;
 				cm = ws->mon;
@@ -225,14 +227,15 @@ badvalue:
 
 int cmdcycle(__attribute__((unused)) char **argv)
 {
-	Client *c = cmdc, *first;
+	Client *c = cmdc, *first, **t;
 
 	if (FLOATING(c) || FULLSCREEN(c) || tilecount(c->ws) <= 1) {
 		respond(cmdresp, "!unable to cycle floating, fullscreen, or single tiled windows");
 		return -1;
 	}
-	if (c == (first = nexttiled(selws->clients)) && !nexttiled(c->next)) return 0;
-	if (!(c = nexttiled(selws->sel->next))) c = first;
+	t = tiled(c->ws);
+	first = t[0];
+	if (!(c = t[c->tidx + 1])) c = first;
 
 	/* TODO: avoid using focus() twice here, possibly just
 	 *
@@ -291,6 +294,7 @@ int cmdfloat(char **argv)
 		return nparsed;
 	}
 
+	RETILE(c);
 	if ((c->state ^= STATE_FLOATING) & STATE_FLOATING) {
 		Monitor *m = c->ws->mon;
 		DBG("cmdfloat: client state is now floating: %s", c->title)
@@ -333,13 +337,12 @@ int cmdfocus(char **argv)
 			c = selws->sel->next ? selws->sel->next : selws->clients;
 			direction--;
 		} else {
-			FIND_PREV(c, selws->sel, selws->clients);
+			c = selws->sel->prev ? selws->sel->prev : selws->ctail;
 			direction++;
 		}
 		if (c) focus(c);
 	}
 	if (c && (FLOATING(c) || c->ws->layout->func == mono)) restack(c->ws);
-	xcb_aux_sync(con);
 	ignore(XCB_ENTER_NOTIFY);
 	return nparsed;
 }
@@ -383,6 +386,7 @@ int cmdhide(__attribute__((unused)) char **argv)
 	Client *c = cmdc;
 
 	c->state &= STATE_HIDDEN;
+	RETILE(c);
 	if (c == selws->sel) unfocus(c, 1);
 	showhide(c->ws->stack);
 	needsrefresh = 1;
@@ -396,10 +400,7 @@ int cmdkill(__attribute__((unused)) char **argv)
 		xcb_grab_server(con);
 		xcb_set_close_down_mode(con, XCB_CLOSE_DOWN_DESTROY_ALL);
 		xcb_kill_client(con, cmdc->win);
-		xcb_aux_sync(con);
 		xcb_ungrab_server(con);
-	} else {
-		xcb_aux_sync(con);
 	}
 	ignore(XCB_ENTER_NOTIFY);
 	return 0;
@@ -410,7 +411,7 @@ int cmdlayout(char **argv)
 	for (unsigned int i = 0; layouts[i].name; i++)
 		if (!strcmp(layouts[i].name, *argv)) {
 			Client *c = NULL;
-			if (tilecount(setws) == 1) c = nexttiled(setws->clients);
+			if (tilecount(setws) == 1) c = setws->tiled[0];
 			if ((lytchange = &layouts[i] != setws->layout)) {
 				needsrefresh = 1;
 				if ((setws->layout = &layouts[i])->func == NULL && c) {
@@ -550,7 +551,7 @@ badvalue:
 
 int cmdresize(char **argv)
 {
-	Client *c = cmdc, *t;
+	Client *c = cmdc;
 	Workspace *ws = c ? c->ws : selws;
 	float f, *sf;
 	int i, nparsed = 0;
@@ -616,8 +617,8 @@ badvalue:
 	} else if (ISTILE(ws)) {
 		if (w != INT_MIN) {
 			if (ws->layout->func == rtile) w += w * -2;
-			for (i = 0, t = nexttiled(ws->clients); t && t != c; t = nexttiled(t->next), i++)
-				;
+			tiled(ws);
+			i = c->tidx;
 			sf = (ws->nmaster && i < ws->nmaster + ws->nstack) ? &ws->msplit : &ws->ssplit;
 			f = relw ? ((ws->mon->ww * *sf) + w) / ws->mon->ww : (float)w / ws->mon->ww;
 			if (f < 0.05 || f > 0.95) {
@@ -648,7 +649,6 @@ badvalue:
 		}
 	}
 end:
-	xcb_aux_sync(con);
 	ignore(XCB_ENTER_NOTIFY);
 	return nparsed;
 #undef ARG
@@ -882,7 +882,7 @@ int cmdset(char **argv)
 						globalcfg[j].val = i;
 						break;
 					case TYPE_NUMWS:
-						if (!argv || (i = parseintclamp(*argv, NULL, 1, 99)) == INT_MIN) goto badvalue;
+						if (!argv || (i = parseintclamp(*argv, NULL, 1, WS_MAX)) == INT_MIN) goto badvalue;
 						if (i > globalcfg[j].val) updworkspaces(i);
 						break;
 					case TYPE_INT:
@@ -944,7 +944,7 @@ int cmdsplit(char **argv)
 
 int cmdstatus(char **argv)
 {
-	int i, nparsed = 0;
+	int i, nparsed = 0, reset = 0;
 	Status s = {
 		.num = -1, .type = STAT_BAR, .file = cmdresp, .path = NULL, .next = NULL
 	};
@@ -957,7 +957,13 @@ int cmdstatus(char **argv)
 			else if (!strcmp("win", *argv))    s.type = STAT_WIN, winchange = 1;
 			else if (!strcmp("full", *argv))   s.type = STAT_FULL;
 			else if (!strcmp("layout", *argv)) s.type = STAT_LYT, lytchange = 1;
+			else if (!strcmp("perf", *argv))   s.type = STAT_PERF;
+			else if (!strcmp("trace", *argv))  s.type = STAT_TRACE;
+			else if (!strcmp("latency", *argv)) s.type = STAT_LATENCY;
+			else if (!strcmp("mem", *argv))    s.type = STAT_MEM;
 			else                               goto badvalue;
+		} else if (!strcmp("reset", *argv)) {
+			reset = 1;
 		} else if (!strcmp("num", *argv)) {
 			argv++, nparsed++;
 			if (!argv || (i = parseintclamp(*argv, NULL, -1, INT_MAX)) == INT_MIN) goto badvalue;
@@ -984,6 +990,7 @@ badvalue:
 			status_usingcmdresp = s.file == cmdresp;
 			printstatus(initstatus(&s), 1);
 		}
+		if (reset) perfreset();
 	} else {
 		respond(cmdresp, "!unable to create status: %s", s.path ? s.path : "stdout");
 	}
@@ -1002,19 +1009,19 @@ int cmdstick(__attribute__((unused)) char **argv)
 	if (c->state & STATE_STICKY) {
 		ws = c->ws->num;
 		c->state &= ~STATE_STICKY;
-		PROP(REPLACE, c->win, netatom[NET_WM_DESK], XCB_ATOM_CARDINAL, 32, 1, &ws);
+		setnetdesk(c, ws);
 	} else {
 		cmdfloat(NULL);
 		c->state |= STATE_STICKY | STATE_FLOATING;
-		PROP(REPLACE, c->win, netatom[NET_WM_DESK], XCB_ATOM_CARDINAL, 32, 1, &ws);
+		RETILE(c);
+		setnetdesk(c, ws);
 	}
 	return 0;
 }
 
 int cmdswap(__attribute__((unused)) char **argv)
 {
-	static Client *last = NULL;
-	Client *c = cmdc, *old, *cur = NULL, *prev = NULL;
+	Client *c = cmdc, *old, *cur, **tl;
 
 	if (FLOATING(c) || (c->state & STATE_FULLSCREEN
 				&& c->w == c->ws->mon->w && c->h == c->ws->mon->h) || tilecount(c->ws) <= 1)
@@ -1022,26 +1029,14 @@ int cmdswap(__attribute__((unused)) char **argv)
 		respond(cmdresp, "!unable to swap floating, fullscreen, or single tiled windows");
 		return 0;
 	}
-	if (c == nexttiled(c->ws->clients)) {
-		FIND_PREV(cur, last, c->ws->clients);
-		if (cur != c->ws->clients)
-			prev = nexttiled(cur->next);
-		if (!prev || prev != last) {
-			last = NULL;
-			if (!(c = nexttiled(c->next))) return 0;
-		} else {
-			c = prev;
-		}
-	}
-	if (c != (old = nexttiled(c->ws->clients)) && !cur)
-		FIND_PREV(cur, c, c->ws->clients);
+	tl = tiled(c->ws);
+	if (c == (old = tl[0]))
+		c = tl[1];
+	cur = c->prev;
 	detach(c, 1);
-	if (c != old && cur && cur != c->ws->clients) {
-		last = old;
-		if (old && cur != old) {
-			detach(old, 0);
-			ATTACH(old, cur->next);
-		}
+	if (cur != old) {
+		detach(old, 0);
+		attachafter(old, cur);
 	}
 	needsrefresh = 1;
 	return 0;
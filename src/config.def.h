@@ -16,6 +16,16 @@ uint32_t border[BORD_LAST] = {
 	[BORD_O_UNFOCUS] = 0xFF222222, /* hex: unfocused window border colour (outer) */
 };
 
+#define POOL_PREALLOC
+unsigned int prealloc[POOL_LAST] = {
+	/* number of objects allocated on startup, more are allocated when needed */
+	[POOL_CLIENT] = 64, /* managed windows */
+	[POOL_PANEL]  = 0,  /* docks and bars */
+	[POOL_DESK]   = 0,  /* desktop windows */
+	[POOL_RULE]   = 16, /* window rules */
+	[POOL_STATUS] = 0,  /* status outputs */
+};
+
 GlobalCfg globalcfg[GLB_LAST] = {
 	/* setting           value,  type,       string */
 	[GLB_FOCUS_MOUSE]  = { 1,   TYPE_BOOL,  "focus_mouse"  }, /* enable focus follows mouse */
@@ -96,7 +106,7 @@ int tstack(Workspace *ws)
 	 * additions to work with dk padding, gaps, and other features.
 	 */
 
-	Client *c;
+	Client *c, **t;
 	int i, n, g, mh, mw, mx, sx, sw = 0;
 
 	if (!(n = tilecount(ws))) return 1;
@@ -121,7 +131,7 @@ int tstack(Workspace *ws)
 		sw = (ww - g) / (n - ws->nmaster);
 	}
 
-	for (i = 0, mx = sx = wx + g, c = nexttiled(ws->clients); c; c = nexttiled(c->next), i++) {
+	for (i = 0, mx = sx = wx + g, t = tiled(ws); (c = t[i]); i++) {
 		/* apply smart border */
 		int bw = !globalcfg[GLB_SMART_BORDER].val || n > 1 ? c->bw : 0;
 		if (i < ws->nmaster) { /* master windows */
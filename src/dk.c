@@ -9,11 +9,6 @@
 #define _XOPEN_SOURCE 700
 #define _POSIX_C_SOURCE 200112L
 
-#ifdef FUNCDEBUG
-#define _GNU_SOURCE
-#include <dlfcn.h>
-#endif
-
 #include <sys/un.h>
 #include <sys/select.h>
 #include <sys/socket.h>
@@ -26,6 +21,7 @@
 #include <regex.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <time.h>
 #include <err.h>
 
 #include <xcb/randr.h>
@@ -42,14 +38,22 @@
 #include "layout.h"
 #include "event.h"
 #include "cmd.h"
+#include "perf.h"
 #include "config.h"
 
+#ifndef POOL_PREALLOC
+/* config.h from before prealloc existed, use the config.def.h values */
+unsigned int prealloc[POOL_LAST] = {
+	[POOL_CLIENT] = 64, [POOL_PANEL] = 0, [POOL_DESK] = 0,
+	[POOL_RULE]   = 16, [POOL_STATUS] = 0,
+};
+#endif
 
 FILE *cmdresp;
 char *argv0, *sock = NULL;
 unsigned int lockmask = 0;
 int scr_h, scr_w, sockfd, randrbase, cmdusemon, winchange, wschange, lytchange;
-int running, restart, needsrefresh, status_usingcmdresp, depth;
+int running, restart, needsrefresh, status_usingcmdresp;
 
 Desk *desks;
 Rule *rules;
@@ -66,6 +70,63 @@ xcb_key_symbols_t *keysyms;
 xcb_cursor_t cursor[CURS_LAST];
 xcb_atom_t wmatom[WM_LAST], netatom[NET_LAST];
 
+/* window id -> tagged entry (see enum WinType) for every window we have classified,
+ * kept in sync by manage(), the init*() functions, and unmanage() */
+static Map wintab;
+
+/* workspace number -> workspace, grown by initws() */
+static Workspace **wstab;
+static int wstabsz;
+
+/* pointer -> monitor lookup used by coordtomon(), the screen is cut into a
+ * grid along every monitor edge and each cell holds the monitor covering it,
+ * rebuilt by updmongrid() whenever the outputs change */
+static Monitor **moncell;
+static int *monx, *mony, nmonx, nmony, hitx = -1, hity = -1;
+
+/* fixed size objects are carved out of slabs, see poolget() */
+/* client titles, see clienttitle() */
+static Arena titles;
+
+static Pool pools[POOL_LAST] = {
+	[POOL_CLIENT] = { .size = sizeof(Client), .nslab = 32, .align = 64 }, /* see Client */
+	[POOL_PANEL]  = { .size = sizeof(Panel),  .nslab = 4 },
+	[POOL_DESK]   = { .size = sizeof(Desk),   .nslab = 4 },
+	[POOL_RULE]   = { .size = sizeof(Rule),   .nslab = 16 },
+	[POOL_STATUS] = { .size = sizeof(Status), .nslab = 4 },
+};
+/* property writes skipped because the value was already set, see wrote() */
+static unsigned int wroteskip;
+static xcb_window_t netactive = XCB_WINDOW_NONE;
+static uint32_t netdeskcur = UINT32_MAX;
+static int netactiveset;
+
+/* size and duration of the startup scan, see initscan() */
+static unsigned int scanwins;
+static double scanms;
+
+/* workspace switches handled by changews() and their cost in milliseconds */
+static unsigned int wsswitches;
+static double wsswitchlast, wsswitchmax, wsswitchtotal;
+
+/* root properties kept in memory, written once per main loop iteration by
+ * netflush() when marked dirty rather than appended to one item at a time */
+static xcb_window_t *netclients;
+static uint32_t *netwsgeom;
+static unsigned int nnetclients, netclientssz, netwsgeomsz;
+static int netclientsdirty, netwsdirty;
+
+/* clientunmap() calls between unmapbegin() and unmapend() share one grab */
+static int unmapping;
+
+static const char *poolnames[POOL_LAST] = {
+	[POOL_CLIENT] = "client",
+	[POOL_PANEL]  = "panel",
+	[POOL_DESK]   = "desk",
+	[POOL_RULE]   = "rule",
+	[POOL_STATUS] = "status",
+};
+
 static uint32_t rootmask = XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT
 				| XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY
 				| XCB_EVENT_MASK_BUTTON_PRESS
@@ -77,6 +138,7 @@ static uint32_t clientmask = XCB_EVENT_MASK_ENTER_WINDOW
 				| XCB_EVENT_MASK_FOCUS_CHANGE
 				| XCB_EVENT_MASK_PROPERTY_CHANGE
 				| XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+static uint32_t rootcur; /* rootmask as currently set, plus pointer motion on multi-head */
 const char *ebadarg = "invalid argument for";
 const char *enoargs = "command requires additional arguments but none were given";
 const char *gravities[] = {
@@ -120,19 +182,43 @@ const char *netatoms[] = {
 };
 
 
+static void clienthintsreply(Client *c, xcb_get_property_cookie_t *ck);
+static int clientnamereply(Client *c, xcb_get_property_cookie_t *net, xcb_get_property_cookie_t *wm);
+static void clientprotosreply(Client *c, xcb_get_property_cookie_t *ck);
+static void clientrulereply(Client *c, Rule *wr, int nofocus, xcb_get_property_cookie_t *desk);
+static void clienttypereply(Client *c, xcb_get_property_cookie_t *state);
+static int edgeidx(int *edges, int n, int v);
+static void freerulemem(Rule *r);
+static void freerulestr(char *s, regex_t *reg);
 static void freestatus(Status *s);
 static void freews(Workspace *ws);
 static void initscan(void);
 static void initsock(void);
 static void initwm(void);
+static void managefetched(xcb_window_t win, WinFetch *f, int scan);
+static double mssince(struct timespec *t0);
+static void netclientadd(xcb_window_t win);
+static void netclientdel(xcb_window_t win);
+static void netflush(void);
 static int refresh(void);
 static void relocatews(Workspace *ws, Monitor *old, int wasvis);
 static int rulecmp(Client *c, Rule *r);
+static void setnetactive(xcb_window_t win);
+static void sizehintsreply(Client *c, xcb_get_property_cookie_t *ck, int uss);
+static void unmapbegin(void);
+static void unmapend(void);
+static void updmongrid(void);
 static void updnetworkspaces(void);
-static xcb_get_window_attributes_reply_t *winattr(xcb_window_t win);
-static void winclass(xcb_window_t win, char *class, char *inst, size_t len);
+static void winclass(xcb_window_t win, const char **class, const char **inst);
+static void winclassreply(xcb_get_property_cookie_t *ck, const char **class, const char **inst);
+static void winfetch(xcb_window_t win, WinFetch *f, int scan);
+static void winfetchdone(WinFetch *f);
+static void winfetchprops(xcb_window_t win, WinFetch *f);
 static xcb_get_geometry_reply_t *wingeom(xcb_window_t win);
 static int winprop(xcb_window_t win, xcb_atom_t prop, xcb_atom_t *ret);
+static int winpropreply(xcb_get_property_cookie_t *ck, xcb_atom_t *ret);
+static xcb_window_t wintransreply(xcb_get_property_cookie_t *ck);
+static int wrote(Client *c, int prop, uint32_t val);
 
 
 int main(int argc, char *argv[])
@@ -147,7 +233,6 @@ int main(int argc, char *argv[])
 	char *end, buf[PIPE_BUF];
 	int cmdfd, confd, nfds;
 
-	depth = 0;
 	argv0 = argv[0];
 	randrbase = -1;
 	running = needsrefresh = 1;
@@ -206,7 +291,9 @@ int main(int argc, char *argv[])
 	confd = xcb_get_file_descriptor(con);
 	nfds = MAX(confd, sockfd) + 1;
 	while (running) {
+		netflush(); /* publish the root lists of every batch before blocking */
 		xcb_flush(con);
+		latend();
 		FD_ZERO(&read_fds);
 		FD_SET(sockfd, &read_fds);
 		FD_SET(confd, &read_fds);
@@ -225,12 +312,19 @@ int main(int argc, char *argv[])
 			}
 			if (FD_ISSET(confd, &read_fds))
 				while ((ev = xcb_poll_for_event(con))) {
+					latstamp();
 					dispatch(ev);
 					free(ev);
 				}
 		}
 		if (xcb_connection_has_error(con)) break;
-		if (needsrefresh) needsrefresh = refresh();
+		do {
+			if (needsrefresh) {
+				PerfOp *prev = perfenter(PERF_OP_REFRESH, "refresh");
+				needsrefresh = refresh();
+				perfleave(prev);
+			}
+		} while (settle());
 		s = stats;
 		while (s) {
 			next = s->next;
@@ -262,6 +356,7 @@ static void applyrule(Client *c, Rule *r, xcb_atom_t curws, int nofocus)
 		c->cb = r->cb;
 		dofocus = r->focus;
 		c->state |= r->state;
+		RETILE(c);
 		xgrav = r->xgrav;
 		ygrav = r->ygrav;
 		c->x = r->x != -1 ? r->x : c->x;
@@ -287,7 +382,7 @@ static void applyrule(Client *c, Rule *r, xcb_atom_t curws, int nofocus)
 		}
 	}
 
-	if (ws + 1 > globalcfg[GLB_WS_NUM].val && ws <= 99)
+	if (ws + 1 > globalcfg[GLB_WS_NUM].val && ws < WS_MAX)
 		updworkspaces(ws + 1);
 	setworkspace(c, MIN(ws, globalcfg[GLB_WS_NUM].val), nofocus);
 
@@ -350,21 +445,38 @@ int applysizehints(Client *c, int *x, int *y, int *w, int *h, int bw, int usermo
 
 static void attach(Client *c, int tohead)
 {
-	Client *tail = NULL;
+	attachafter(c, tohead ? NULL : c->ws->ctail);
+}
 
-	if (!tohead)
-		FIND_TAIL(tail, c->ws->clients);
-	if (tail)
-		ATTACH(c, tail->next);
+void attachafter(Client *c, Client *after)
+{
+	/* insert c after the given client, or at the head when NULL */
+	Workspace *ws = c->ws;
+
+	c->prev = after;
+	c->next = after ? after->next : ws->clients;
+	if (c->next)
+		c->next->prev = c;
+	else
+		ws->ctail = c;
+	if (after)
+		after->next = c;
 	else
-		ATTACH(c, c->ws->clients);
+		ws->clients = c;
+	RETILE(c);
 }
 
 static void attachstack(Client *c)
 {
-	c->snext = c->ws->stack;
-	c->ws->stack = c;
-	c->ws->sel = c;
+	Workspace *ws = c->ws;
+
+	c->sprev = NULL;
+	if ((c->snext = ws->stack))
+		ws->stack->sprev = c;
+	else
+		ws->stail = c;
+	ws->stack = c;
+	ws->sel = c;
 }
 
 int assignws(Workspace *ws, Monitor *new)
@@ -398,9 +510,11 @@ int assignws(Workspace *ws, Monitor *new)
 void changews(Workspace *ws, int swap, int warp)
 {
 	Monitor *m;
+	struct timespec t0;
 	Workspace *hidews = ws->mon->ws;
 
 	if (!ws || ws == selws) return;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 	DBG("changews: %d:%s -> %d:%s - swap: %d - warp: %d",
 			selws->num, selws->mon->name, ws->num, ws->mon->name, swap, warp)
 	int dowarp = !swap && warp && selws->mon != ws->mon;
@@ -422,6 +536,10 @@ void changews(Workspace *ws, int swap, int warp)
 	selws = ws;
 	selmon = selws->mon;
 	selmon->ws = selws;
+
+	/* map the new and unmap the old workspace under a single server grab so
+	 * the switch is applied at once rather than one window at a time */
+	unmapbegin();
 	showhide(selws->stack);
 	if (dowarp) {
 		xcb_warp_pointer(con, root, root, 0, 0, 0, 0,
@@ -431,12 +549,24 @@ void changews(Workspace *ws, int swap, int warp)
 	} else {
 		showhide(lastws->stack);
 	}
+	unmapend();
 	ignore(XCB_ENTER_NOTIFY);
 	ignore(XCB_CONFIGURE_REQUEST);
-	PROP(REPLACE, root, netatom[NET_DESK_CUR], XCB_ATOM_CARDINAL, 32, 1, &ws->num);
+	if (netdeskcur != (uint32_t)ws->num) {
+		netdeskcur = ws->num;
+		PROP(REPLACE, root, netatom[NET_DESK_CUR], XCB_ATOM_CARDINAL, 32, 1, &ws->num);
+	} else {
+		wroteskip++;
+	}
 	xcb_flush(con);
 	needsrefresh = 1;
 	wschange = 1;
+
+	wsswitchlast = mssince(&t0);
+	wsswitchtotal += wsswitchlast;
+	wsswitchmax = MAX(wsswitchmax, wsswitchlast);
+	wsswitches++;
+	DBG("changews: switch took %.3fms", wsswitchlast)
 }
 
 void clientborder(Client *c, int focused)
@@ -464,6 +594,7 @@ void clientborder(Client *c, int focused)
 			{ 1,            1,            1,            1            }
 		};
 
+		PERFN(PERF_REQUEST, 8);
 		xcb_pixmap_t pmap = xcb_generate_id(con);
 		xcb_gcontext_t gc = xcb_generate_id(con);
 		xcb_create_pixmap(con, c->depth, pmap, c->win, W(c), H(c));
@@ -474,103 +605,176 @@ void clientborder(Client *c, int focused)
 		xcb_change_window_attributes(con, c->win, XCB_CW_BORDER_PIXMAP, &pmap);
 		xcb_free_pixmap(con, pmap);
 		xcb_free_gc(con, gc);
-		xcb_aux_sync(con);
+		xcb_flush(con);
 	} else {
+		PERF(PERF_REQUEST);
 		xcb_change_window_attributes(con, c->win, XCB_CW_BORDER_PIXEL, &in);
 		xcb_flush(con);
 	}
 }
 
 void clienthints(Client *c)
+{
+	xcb_get_property_cookie_t ck = xcb_icccm_get_wm_hints(con, c->win);
+
+	PERF(PERF_REQUEST);
+	clienthintsreply(c, &ck);
+}
+
+static void clienthintsreply(Client *c, xcb_get_property_cookie_t *ck)
 {
 	xcb_generic_error_t *e;
 	xcb_icccm_wm_hints_t wmh;
 
-	if (xcb_icccm_get_wm_hints_reply(con, xcb_icccm_get_wm_hints(con, c->win), &wmh, &e)) {
+	PERF(PERF_REPLY);
+	if ((c->haswmh = xcb_icccm_get_wm_hints_reply(con, *ck, &wmh, &e))) {
 		if (c == selws->sel && wmh.flags & XCB_ICCCM_WM_HINT_X_URGENCY) {
 			wmh.flags &= ~XCB_ICCCM_WM_HINT_X_URGENCY;
+			PERF(PERF_REQUEST);
 			xcb_icccm_set_wm_hints(con, c->win, &wmh);
 		} else if (wmh.flags & XCB_ICCCM_WM_HINT_X_URGENCY) {
 			c->state |= STATE_URGENT;
 		}
 		if ((wmh.flags & XCB_ICCCM_WM_HINT_INPUT) && !wmh.input)
 			c->state |= STATE_NOINPUT;
+		c->wmh = wmh;
 	} else {
 		iferr(0, "unable to get window wm hints reply", e);
 	}
+	ck->sequence = 0;
 }
 
 void clientmap(Client *c)
 {
 	DBG("clientmap: %s", c->title)
 	setwinstate(c->win, XCB_ICCCM_WM_STATE_NORMAL);
+	PERF(PERF_REQUEST);
 	xcb_map_window(con, c->win);
 	c->state &= ~STATE_NEEDSMAP;
-	xcb_aux_sync(con);
 }
 
 void clientunmap(Client *c)
 {
 	DBG("clientunmap: %s", c->title)
-	xcb_get_window_attributes_reply_t *ra = winattr(root), *ca = winattr(c->win);
-	uint32_t rm = (ra->your_event_mask & ~XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY);
-	uint32_t cm = (ca->your_event_mask & ~XCB_EVENT_MASK_STRUCTURE_NOTIFY);
+	/* clients only ever have clientmask, see initclient() */
+	uint32_t cm = (clientmask & ~XCB_EVENT_MASK_STRUCTURE_NOTIFY);
 
-	xcb_grab_server(con);
-	xcb_change_window_attributes(con, root, XCB_CW_EVENT_MASK, &rm);
+	unmapbegin();
+	PERFN(PERF_REQUEST, 3);
 	xcb_change_window_attributes(con, c->win, XCB_CW_EVENT_MASK, &cm);
 	xcb_unmap_window(con, c->win);
 	setwinstate(c->win, XCB_ICCCM_WM_STATE_WITHDRAWN);
-	xcb_change_window_attributes(con, root, XCB_CW_EVENT_MASK, &ra->your_event_mask);
-	xcb_change_window_attributes(con, c->win, XCB_CW_EVENT_MASK, &ca->your_event_mask);
-	xcb_aux_sync(con);
-	xcb_ungrab_server(con);
+	xcb_change_window_attributes(con, c->win, XCB_CW_EVENT_MASK, &clientmask);
+	unmapend();
+}
+
+static void clienttitle(Client *c, const char *s, size_t len)
+{
+	/* titles are exact length and never truncated, a title of the same
+	 * length is overwritten in place otherwise it moves within the arena */
+	if (len + 1 == c->titlesz) {
+		memcpy(c->title, s, len);
+		return;
+	}
+	memcount(MEM_CLIENT, 0, (long)(len + 1) - (long)c->titlesz);
+	arenafree(&titles, c->title, c->titlesz);
+	c->title = arenastr(&titles, s, len);
+	c->titlesz = len + 1;
 }
 
 int clientname(Client *c)
 {
+	xcb_get_property_cookie_t net, wm = { 0 };
+
+	PERF(PERF_REQUEST);
+	net = xcb_icccm_get_text_property(con, c->win, netatom[NET_WM_NAME]);
+	return clientnamereply(c, &net, &wm);
+}
+
+static int clientnamereply(Client *c, xcb_get_property_cookie_t *net, xcb_get_property_cookie_t *wm)
+{
+	/* the WM_NAME fallback is only requested here when it wasn't sent up front */
+	int ok;
 	xcb_generic_error_t *e;
 	xcb_icccm_get_text_property_reply_t r;
 
-	if (!xcb_icccm_get_text_property_reply(con,
-				xcb_icccm_get_text_property(con, c->win, netatom[NET_WM_NAME]), &r, &e))
-	{
+	PERF(PERF_REPLY);
+	ok = xcb_icccm_get_text_property_reply(con, *net, &r, &e);
+	net->sequence = 0;
+	if (!ok) {
 		iferr(0, "unable to get NET_WM_NAME text property reply", e);
-		if (!xcb_icccm_get_text_property_reply(con,
-					xcb_icccm_get_text_property(con, c->win, XCB_ATOM_WM_NAME), &r, &e))
-		{
+		if (!wm->sequence)
+			PERF(PERF_REQUEST), *wm = xcb_icccm_get_text_property(con, c->win, XCB_ATOM_WM_NAME);
+		PERF(PERF_REPLY);
+		ok = xcb_icccm_get_text_property_reply(con, *wm, &r, &e);
+		wm->sequence = 0;
+		if (!ok) {
 			iferr(0, "unable to get WM_NAME text property reply", e);
-			strlcpy(c->title, "broken", sizeof(c->title));
+			clienttitle(c, "broken", 6);
 			return 0;
 		}
 	}
 	if (r.name_len > 0)
-		strlcpy(c->title, r.name, MIN(sizeof(c->title), r.name_len + 1));
+		clienttitle(c, r.name, strnlen(r.name, r.name_len));
 	else
-		strlcpy(c->title, "broken", sizeof(c->title));
+		clienttitle(c, "broken", 6);
 	xcb_icccm_get_text_property_reply_wipe(&r);
 	return 1;
 }
 
+void clientprotos(Client *c)
+{
+	xcb_get_property_cookie_t ck = xcb_icccm_get_wm_protocols(con, c->win, wmatom[WM_PROTO]);
+
+	PERF(PERF_REQUEST);
+	clientprotosreply(c, &ck);
+}
+
+static void clientprotosreply(Client *c, xcb_get_property_cookie_t *ck)
+{
+	xcb_generic_error_t *e;
+	xcb_icccm_get_wm_protocols_reply_t proto;
+
+	c->protos = 0;
+	PERF(PERF_REPLY);
+	if (xcb_icccm_get_wm_protocols_reply(con, *ck, &proto, &e)) {
+		for (unsigned int i = 0; i < proto.atoms_len; i++)
+			for (unsigned int j = 0; j < WM_LAST; j++)
+				if (proto.atoms[i] == wmatom[j]) c->protos |= 1 << j;
+		xcb_icccm_get_wm_protocols_reply_wipe(&proto);
+	} else {
+		iferr(0, "unable to get wm protocols reply", e);
+	}
+	ck->sequence = 0;
+}
+
 void clientrule(Client *c, Rule *wr, int nofocus)
 {
+	xcb_get_property_cookie_t desk = { 0 };
+
+	if (!c->trans)
+		PERF(PERF_REQUEST), desk = xcb_get_property(con, 0, c->win, netatom[NET_WM_DESK], XCB_ATOM_ANY, 0, 1);
+	clientrulereply(c, wr, nofocus, &desk);
+}
+
+static void clientrulereply(Client *c, Rule *wr, int nofocus, xcb_get_property_cookie_t *desk)
+{
+	/* desk is only read when the client is not a transient */
 	Rule *r = wr;
-	xcb_atom_t type = 0;
 	xcb_atom_t curws = selws->num;
 
 	if (c->trans)
 		curws = c->trans->ws->num;
-	else if (!winprop(c->win, netatom[NET_WM_DESK], &curws) || curws > 99)
+	else if (!winpropreply(desk, &curws) || curws >= WS_MAX)
 		curws = selws->num;
-	winprop(c->win, netatom[NET_WM_TYPE], &type);
 
 	if (!r) {
 		for (r = rules; r; r = r->next)
-			if (rulecmp(c, r) && (!r->type || r->type == type)) {
+			if (rulecmp(c, r) && (!r->type || r->type == c->type)) {
 				applyrule(c, r, curws, nofocus);
 				return;
 			}
-	} else if (rulecmp(c, r) && (!r->type || r->type == type)) {
+	} else if (rulecmp(c, r) && (!r->type || r->type == c->type)) {
 		applyrule(c, r, curws, nofocus);
 		return;
 	}
@@ -580,45 +784,111 @@ void clientrule(Client *c, Rule *wr, int nofocus)
 
 void clienttype(Client *c)
 {
-	xcb_atom_t type, state;
+	xcb_atom_t type;
+	xcb_get_property_cookie_t sc, tc, trc;
+
+	PERFN(PERF_REQUEST, 2);
+	sc = xcb_get_property(con, 0, c->win, netatom[NET_WM_STATE], XCB_ATOM_ANY, 0, 1);
+	tc = xcb_get_property(con, 0, c->win, netatom[NET_WM_TYPE], XCB_ATOM_ANY, 0, 1);
+	if (!c->trans) {
+		PERF(PERF_REQUEST);
+		trc = xcb_icccm_get_wm_transient_for(con, c->win);
+		settrans(c, wintoclient(wintransreply(&trc)));
+	}
+	c->type = winpropreply(&tc, &type) ? type : XCB_NONE;
+	clienttypereply(c, &sc);
+}
+
+static void clienttypereply(Client *c, xcb_get_property_cookie_t *state)
+{
+	xcb_atom_t s;
 
-	if (winprop(c->win, netatom[NET_WM_STATE], &state)) {
-		if (state == netatom[NET_STATE_FULL])
+	if (winpropreply(state, &s)) {
+		if (s == netatom[NET_STATE_FULL])
 			setfullscreen(c, 1);
-		else if (state == netatom[NET_STATE_ABOVE])
+		else if (s == netatom[NET_STATE_ABOVE])
 			c->state |= STATE_ABOVE | STATE_FLOATING;
 	}
-	if ((winprop(c->win, netatom[NET_WM_TYPE], &type)
-				&& (type == netatom[NET_TYPE_DIALOG] || type == netatom[NET_TYPE_SPLASH]))
-			|| c->trans || (c->trans = wintoclient(wintrans(c->win))))
+	if (c->type == netatom[NET_TYPE_DIALOG] || c->type == netatom[NET_TYPE_SPLASH] || c->trans)
 		c->state |= STATE_FLOATING;
+	RETILE(c);
 }
 
 Monitor *coordtomon(int x, int y)
 {
-	Monitor *m;
+	int i, j;
 
-	FOR_EACH(m, monitors)
-		if (m->connected && x >= m->x && x < m->x + m->w && y >= m->y && y < m->y + m->h)
-			return m;
-	return NULL;
+	/* pointer motion mostly stays within the same cell */
+	if (hitx < 0 || x < monx[hitx] || x >= monx[hitx + 1] || y < mony[hity] || y >= mony[hity + 1]) {
+		if ((i = edgeidx(monx, nmonx, x)) < 0 || (j = edgeidx(mony, nmony, y)) < 0)
+			return NULL;
+		hitx = i, hity = j;
+	}
+	return moncell[(hity * (nmonx - 1)) + hitx];
 }
 
 void detach(Client *c, int reattach)
 {
-	Client **cc = &c->ws->clients;
+	Workspace *ws = c->ws;
 
-	DETACH(c, cc);
-	if (reattach) ATTACH(c, c->ws->clients);
+	if (c->prev)
+		c->prev->next = c->next;
+	else
+		ws->clients = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	else
+		ws->ctail = c->prev;
+	if (reattach)
+		attachafter(c, NULL);
+	RETILE(c);
 }
 
 static void detachstack(Client *c)
 {
-	Client **cc = &c->ws->stack;
+	Workspace *ws = c->ws;
+
+	if (c->sprev)
+		c->sprev->snext = c->snext;
+	else
+		ws->stack = c->snext;
+	if (c->snext)
+		c->snext->sprev = c->sprev;
+	else
+		ws->stail = c->sprev;
+	if (c == ws->sel) ws->sel = ws->stack;
+}
+
+static int edgeidx(int *edges, int n, int v)
+{
+	/* index of the interval edges[i] <= v < edges[i + 1], -1 when outside all of them */
+	int lo = 0, hi = n - 1, mid;
+
+	if (n < 2 || v < edges[0] || v >= edges[hi]) return -1;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (v < edges[mid])
+			hi = mid;
+		else
+			lo = mid;
+	}
+	return lo;
+}
+
+static int edgesort(int *edges, int n)
+{
+	/* sort and drop duplicates, returns the new length */
+	int i, j, v;
 
-	while (*cc && *cc != c) cc = &(*cc)->snext;
-	*cc = c->snext;
-	if (c == c->ws->sel) c->ws->sel = c->ws->stack;
+	for (i = 1; i < n; i++) {
+		for (v = edges[i], j = i; j > 0 && edges[j - 1] > v; j--)
+			edges[j] = edges[j - 1];
+		edges[j] = v;
+	}
+	for (i = j = 0; i < n; i++)
+		if (!j || edges[j - 1] != edges[i])
+			edges[j++] = edges[i];
+	return j;
 }
 
 void execcfg(void)
@@ -651,7 +921,9 @@ void fillstruts(Panel *p)
 	xcb_get_property_reply_t *prop = NULL;
 	xcb_get_property_cookie_t rc = xcb_get_property(con, 0, p->win, netatom[NET_WM_STRUTP], XCB_ATOM_CARDINAL, 0, 4);
 
+	PERF(PERF_REQUEST), PERF(PERF_REPLY);
 	if (!(prop = xcb_get_property_reply(con, rc, &err)) || prop->type == XCB_NONE) {
+		PERF(PERF_REQUEST), PERF(PERF_REPLY);
 		rc = xcb_get_property(con, 0, p->win, netatom[NET_WM_STRUT], XCB_ATOM_CARDINAL, 0, 4);
 		iferr(0, "unable to get _NET_WM_STRUT_PARTIAL reply from window", err);
 		if (!(prop = xcb_get_property_reply(con, rc, &err)))
@@ -665,7 +937,10 @@ void fillstruts(Panel *p)
 void focus(Client *c)
 {
 	if (!selws) selws = workspaces;
-	if (!c) c = selws ? selws->stack : NULL;
+	if (!c || c->state & STATE_WITHDRAWING)
+		for (c = selws ? selws->stack : NULL; c && c->state & STATE_WITHDRAWING; c = c->snext)
+			;
+	trace(TR_FOCUS, c ? c->win : 0, 0);
 	if (selws && selws->sel) unfocus(selws->sel, 0);
 	if (c) {
 		if (c->state & STATE_URGENT) seturgent(c, 0);
@@ -688,6 +963,7 @@ static void freemon(Monitor *m)
 	Monitor **mm = &monitors;
 
 	DETACH(m, mm);
+	memcount(MEM_MON, -1, -(long)sizeof(Monitor));
 	free(m);
 }
 
@@ -696,11 +972,30 @@ void freerule(Rule *r)
 	Rule **rr = &rules;
 
 	DETACH(r, rr);
-	if (r->class) { regfree(&(r->classreg)); free(r->class); }
-	if (r->inst) { regfree(&(r->instreg)); free(r->inst); }
-	if (r->title) { regfree(&(r->titlereg)); free(r->title); }
-	free(r->mon);
-	free(r);
+	strrelease(r->classseen);
+	strrelease(r->instseen);
+	freerulemem(r);
+}
+
+static void freerulemem(Rule *r)
+{
+	freerulestr(r->class, &(r->classreg));
+	freerulestr(r->inst, &(r->instreg));
+	freerulestr(r->title, &(r->titlereg));
+	freerulestr(r->mon, NULL);
+	memcount(MEM_RULE, -1, -(long)sizeof(Rule));
+	poolput(&pools[POOL_RULE], r);
+}
+
+static void freerulestr(char *s, regex_t *reg)
+{
+	if (!s) return;
+	if (reg) {
+		regfree(reg);
+		memcount(MEM_REGEX, -1, -MEM_REGEXSZ(s));
+	}
+	memcount(MEM_RULE, 0, -(long)(strlen(s) + 1));
+	free(s);
 }
 
 static void freestatus(Status *s)
@@ -709,8 +1004,12 @@ static void freestatus(Status *s)
 
 	DETACH(s, ss);
 	if (!restart) fclose(s->file);
-	if (s->path) free(s->path);
-	free(s);
+	if (s->path) {
+		memcount(MEM_STATUS, 0, -(long)(strlen(s->path) + 1));
+		free(s->path);
+	}
+	memcount(MEM_STATUS, -1, -(long)sizeof(Status));
+	poolput(&pools[POOL_STATUS], s);
 }
 
 void freewm(void)
@@ -722,15 +1021,27 @@ void freewm(void)
 	while (desks) unmanage(desks->win, 0);
 
 	FOR_CLIENTS(c, ws) clientmap(c);
+	PERF(PERF_SYNC);
 	xcb_aux_sync(con);
 
 	while ((ws = workspaces)) {
 		while (ws->stack) unmanage(ws->stack->win, 0);
 		freews(ws);
 	}
+	free(wstab);
+	wstab = NULL, wstabsz = 0;
+	free(netclients);
+	free(netwsgeom);
 	while (monitors) freemon(monitors);
+	free(moncell);
+	free(monx);
+	free(mony);
 	while (rules) freerule(rules);
 	while (stats) freestatus(stats);
+	mapfree(&wintab);
+	for (unsigned int i = 0; i < LEN(pools); i++)
+		poolfree(&pools[i]);
+	arenadestroy(&titles);
 
 	xcb_key_symbols_free(keysyms);
 	for (unsigned int i = 0; i < LEN(cursors); i++)
@@ -741,6 +1052,7 @@ void freewm(void)
 
 	if (!restart)
 		xcb_delete_property(con, root, netatom[NET_ACTIVE]);
+	PERF(PERF_SYNC);
 	xcb_aux_sync(con);
 	xcb_disconnect(con);
 
@@ -767,32 +1079,18 @@ static void freews(Workspace *ws)
 		selmon = selws->mon;
 		selmon->ws = selws;
 	}
+	if (ws->next)
+		ws->next->prev = ws->prev;
 	DETACH(ws, wws);
+	wstab[ws->num] = NULL;
+	memcount(MEM_WS, -1, -(long)(sizeof(Workspace) + ws->tiledsz * sizeof(Client *)));
+	free(ws->tiled);
 	free(ws);
 }
 
 void grabbuttons(Client *c)
 {
-	xcb_generic_error_t *e;
-	xcb_get_modifier_mapping_reply_t *m = NULL;
-
-	lockmask = 0;
-	if ((m = xcb_get_modifier_mapping_reply(con, xcb_get_modifier_mapping(con), &e))) {
-		xcb_keycode_t *k, *t = NULL;
-		if ((t = xcb_key_symbols_get_keycode(keysyms, 0xff7f))
-				&& (k = xcb_get_modifier_mapping_keycodes(m)))
-		{
-			for (unsigned int i = 0; i < 8; i++)
-				for (unsigned int j = 0; j < m->keycodes_per_modifier; j++)
-					if (k[i * m->keycodes_per_modifier + j] == *t)
-						lockmask = (1 << i);
-		}
-		free(t);
-	} else {
-		iferr(0, "unable to get modifier mapping for numlock", e);
-	}
-	free(m);
-
+	PERFN(PERF_REQUEST, 10);
 	xcb_ungrab_button(con, XCB_BUTTON_INDEX_ANY, c->win, XCB_BUTTON_MASK_ANY);
 	xcb_grab_button(con, 0, c->win, XCB_EVENT_MASK_BUTTON_PRESS,
 			XCB_GRAB_MODE_SYNC, XCB_GRAB_MODE_SYNC, XCB_NONE, XCB_NONE,
@@ -869,14 +1167,14 @@ static void initatoms(xcb_atom_t *atoms, const char **names, int num)
 	}
 }
 
-static void initclient(xcb_window_t win, xcb_get_geometry_reply_t *g)
+static void initclient(xcb_window_t win, xcb_get_geometry_reply_t *g, WinFetch *f, xcb_atom_t type)
 {
 	Client *c;
 	xcb_generic_error_t *e;
-	xcb_get_property_cookie_t pc;
 	xcb_get_property_reply_t *pr = NULL;
 
-	c = ecalloc(1, sizeof(Client));
+	c = poolget(&pools[POOL_CLIENT]);
+	memcount(MEM_CLIENT, 1, sizeof(Client));
 	c->win = win;
 	c->depth = g->depth;
 	c->x = c->old_x = g->x;
@@ -886,21 +1184,29 @@ static void initclient(xcb_window_t win, xcb_get_geometry_reply_t *g)
 	c->bw = c->old_bw = border[BORD_WIDTH];
 	c->state = STATE_NEEDSMAP;
 	c->old_state = STATE_NONE;
-	c->trans = wintoclient(wintrans(win));
 
-	winclass(win, c->class, c->inst, sizeof(c->class));
+	winclassreply(&f->class, &c->class, &c->inst);
 
 	/* broken ass windows like new steam notifications we don't even bother managing :| */
-	if (!strncmp(c->class, "broken", sizeof(c->class))) {
+	if (!strcmp(c->class, "broken")) {
 		DBG("initclient: not managing window: 0x%08x - %s", c->win, c->class)
-		free(c);
+		mapset(&wintab, win, WIN_IGNORE, NULL);
+		strrelease(c->class);
+		strrelease(c->inst);
+		memcount(MEM_CLIENT, -1, -(long)sizeof(Client));
+		poolput(&pools[POOL_CLIENT], c);
 		ignore(XCB_ENTER_NOTIFY);
-		xcb_aux_sync(con);
 		return;
 	}
+	mapset(&wintab, win, WIN_CLIENT, c);
+	if (f->trans.sequence)
+		f->transfor = wintransreply(&f->trans);
+	settrans(c, wintoclient(f->transfor));
 
-	pc = xcb_get_property(con, 0, c->win, wmatom[WM_MOTIF], wmatom[WM_MOTIF], 0, 5);
-	if ((pr = xcb_get_property_reply(con, pc, &e))
+	PERF(PERF_REPLY);
+	pr = xcb_get_property_reply(con, f->motif, &e);
+	f->motif.sequence = 0;
+	if (pr
 			&& xcb_get_property_value_length(pr) >= 3) {
 		if (((xcb_atom_t *)xcb_get_property_value(pr))[2] == 0) {
 			c->bw = 0;
@@ -911,10 +1217,12 @@ static void initclient(xcb_window_t win, xcb_get_geometry_reply_t *g)
 	}
 	free(pr);
 
-	clientname(c);
-	sizehints(c, 1);
-	clienttype(c);
-	clienthints(c);
+	clientnamereply(c, &f->netname, &f->wmname);
+	sizehintsreply(c, &f->normal, 1);
+	c->type = type;
+	clienttypereply(c, &f->state);
+	clienthintsreply(c, &f->hints);
+	clientprotosreply(c, &f->proto);
 
 	DBG("initclient: %s", c->title)
 	if (c->trans && FULLSCREEN(c->trans)) {
@@ -926,8 +1234,9 @@ static void initclient(xcb_window_t win, xcb_get_geometry_reply_t *g)
 	 * the new client is attached to the end of the stack, otherwise the head.
 	 * later in refresh(), focus(NULL) is called to focus the correct client */
 	DBG("initclient: rule setting: %s", c->title)
-	clientrule(c, NULL, !globalcfg[GLB_FOCUS_OPEN].val);
+	clientrulereply(c, NULL, !globalcfg[GLB_FOCUS_OPEN].val, &f->desk);
 
+	PERF(PERF_REQUEST);
 	xcb_change_window_attributes(con, win, XCB_CW_EVENT_MASK, &clientmask);
 	grabbuttons(c);
 	if ((FLOATING(c) || c->state & STATE_FIXED) && !(c->state & STATE_FULLSCREEN)) {
@@ -952,11 +1261,14 @@ static void initdesk(xcb_window_t win, xcb_get_geometry_reply_t *g)
 	Desk *d;
 	uint32_t deskmask = XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
 
-	d = ecalloc(1, sizeof(Desk));
+	d = poolget(&pools[POOL_DESK]);
+	memcount(MEM_DESK, 1, sizeof(Desk));
 	d->win = win;
 	if (!(d->mon = coordtomon(g->x, g->y))) d->mon = selws->mon;
 	d->state |= STATE_NEEDSMAP;
 	ATTACH(d, desks);
+	mapset(&wintab, win, WIN_DESK, d);
+	PERF(PERF_REQUEST);
 	xcb_change_window_attributes(con, d->win, XCB_CW_EVENT_MASK, &deskmask);
 	MOVERESIZE(win, d->mon->x, d->mon->y, d->mon->w, d->mon->h, g->border_width);
 	setstackmode(d->win, XCB_STACK_MODE_BELOW);
@@ -967,6 +1279,7 @@ static void initmon(int num, char *name, xcb_randr_output_t id, int x, int y, in
 	Monitor *m, *tail;
 
 	m = ecalloc(1, sizeof(Monitor));
+	memcount(MEM_MON, 1, sizeof(Monitor));
 	m->id = id;
 	m->num = num;
 	m->connected = 1;
@@ -987,7 +1300,8 @@ static void initpanel(xcb_window_t win, xcb_get_geometry_reply_t *g)
 	Panel *p;
 	uint32_t panelmask = XCB_EVENT_MASK_PROPERTY_CHANGE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
 
-	p = ecalloc(1, sizeof(Panel));
+	p = poolget(&pools[POOL_PANEL]);
+	memcount(MEM_PANEL, 1, sizeof(Panel));
 	p->win = win;
 	p->x = g->x;
 	p->y = g->y;
@@ -995,10 +1309,12 @@ static void initpanel(xcb_window_t win, xcb_get_geometry_reply_t *g)
 	p->h = g->height;
 	p->state |= STATE_NEEDSMAP;
 	if (!(p->mon = coordtomon(g->x, g->y))) p->mon = selws->mon;
-	winclass(win, p->class, p->inst, sizeof(p->class));
+	winclass(win, &p->class, &p->inst);
 	ATTACH(p, panels);
+	mapset(&wintab, win, WIN_PANEL, p);
 	fillstruts(p);
 	updstruts();
+	PERF(PERF_REQUEST);
 	xcb_change_window_attributes(con, p->win, XCB_CW_EVENT_MASK, &panelmask);
 }
 
@@ -1011,17 +1327,23 @@ Rule *initrule(Rule *wr)
 
 #define CPYSTR(dst, src)                           \
 	dst = ecalloc(1, (len = strlen(src) + 1)); \
+	memcount(MEM_RULE, 0, len);                \
 	strlcpy(dst, src, len)
 #define INITREG(str, reg)                                            \
 	if ((i = regcomp(reg, str, REG_NOSUB|REG_EXTENDED|REG_ICASE))) { \
 		regerror(i, reg, buf, sizeof(buf));                          \
 		respond(cmdresp, "!invalid regex %s: %s", str, buf);         \
+		freerulestr(str, NULL);                                      \
+		str = NULL;                                                  \
 		goto error;                                                  \
-	}
-#define FREEREG(str, wstr, reg) if (wstr) { regfree(reg); free(str); }
+	}                                                                \
+	memcount(MEM_REGEX, 1, MEM_REGEXSZ(str));
 
-	r = ecalloc(1, sizeof(Rule));
+	r = poolget(&pools[POOL_RULE]);
 	memcpy(r, wr, sizeof(Rule)); // NOLINT
+	memcount(MEM_RULE, 1, sizeof(Rule));
+	/* only free what's been copied below, the rest still belongs to wr */
+	r->mon = r->title = r->class = r->inst = NULL;
 	if (wr->mon) { CPYSTR(r->mon, wr->mon); }
 	if (wr->title) { CPYSTR(r->title, wr->title); INITREG(r->title, &(r->titlereg)) }
 	if (wr->class) { CPYSTR(r->class, wr->class); INITREG(r->class, &(r->classreg)) }
@@ -1030,38 +1352,87 @@ Rule *initrule(Rule *wr)
 	return r;
 
 error:
-	FREEREG(r->title, wr->title, &(r->titlereg))
-	FREEREG(r->class, wr->class, &(r->classreg))
-	FREEREG(r->inst, wr->inst, &(r->instreg))
-	if (wr->mon) free(r->mon);
-	free(r);
+	freerulemem(r);
 	return NULL;
 
 #undef INITREG
-#undef FREEREG
 #undef CPYSTR
 }
 
 static void initscan(void)
 {
-	unsigned int i;
+	/* attributes for every child are sent before any reply is read, then the
+	 * property batch only for windows that will be managed, so the whole tree
+	 * costs two round trips, windows are managed with parents ahead of their
+	 * transients so settrans() can find them */
+	int n;
+	MapEnt *m;
+	Map pending = {0};
+	unsigned int i, j, k, *chain = NULL;
+	WinFetch *f = NULL;
+	xcb_window_t *w;
+	xcb_atom_t state;
+	struct timespec t0;
 	xcb_generic_error_t *e;
 	xcb_query_tree_reply_t *rt;
 
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 	xcb_query_tree_cookie_t rc = xcb_query_tree(con, root);
+	PERF(PERF_REQUEST), PERF(PERF_REPLY);
 	if (!(rt = xcb_query_tree_reply(con, rc, &e))) {
 		iferr(1, "unable to query tree from root window", e);
 	} else if (rt->children_len) {
-		xcb_window_t *w = xcb_query_tree_children(rt);
-		for (i = 0; i < rt->children_len; i++)
-			if (!wintrans(w[i])) {
-				manage(w[i], 1);
+		w = xcb_query_tree_children(rt);
+		f = ecalloc(rt->children_len, sizeof(WinFetch));
+		chain = ecalloc(rt->children_len, sizeof(unsigned int));
+		for (i = 0, n = 0; i < rt->children_len; i++)
+			if (wintype(w[i], NULL) == WIN_NONE)
+				winfetch(w[i], &f[i], 1), n++;
+			else
 				w[i] = XCB_WINDOW_NONE;
+
+		/* override_redirect and withdrawn windows never become clients */
+		for (i = 0; i < rt->children_len; i++) {
+			if (w[i] == XCB_WINDOW_NONE) continue;
+			PERF(PERF_REPLY);
+			f[i].wa = xcb_get_window_attributes_reply(con, f[i].attr, &e);
+			f[i].attr.sequence = 0;
+			if (!f[i].wa) {
+				iferr(0, "unable to get window attributes reply", e);
+				winfetchdone(&f[i]);
+				w[i] = XCB_WINDOW_NONE;
+			} else if (!f[i].wa->override_redirect
+					&& (f[i].wa->map_state == XCB_MAP_STATE_VIEWABLE
+						|| (winpropreply(&f[i].wmstate, &state) && state == XCB_ICCCM_WM_STATE_ICONIC)))
+			{
+				winfetchprops(w[i], &f[i]);
+				mapset(&pending, w[i], i, NULL);
 			}
+		}
 		for (i = 0; i < rt->children_len; i++)
-			if (w[i] != XCB_WINDOW_NONE)
-				manage(w[i], 1);
+			if (f[i].props)
+				f[i].transfor = wintransreply(&f[i].trans);
+
+		/* follow each transient up to the first parent that isn't waiting to
+		 * be managed and manage back down, leaving the map breaks cycles */
+		for (i = 0; i < rt->children_len; i++) {
+			for (k = 0, j = i; w[j] != XCB_WINDOW_NONE; j = m->tag) {
+				chain[k++] = j;
+				mapdel(&pending, w[j]);
+				if (!(m = mapget(&pending, f[j].transfor))) break;
+			}
+			while (k--) {
+				managefetched(w[chain[k]], &f[chain[k]], 1);
+				w[chain[k]] = XCB_WINDOW_NONE;
+			}
+		}
+		scanwins = n;
 	}
+	scanms = mssince(&t0);
+	DBG("initscan: %u windows in %.3fms", scanwins, scanms)
+	mapfree(&pending);
+	free(chain);
+	free(f);
 	free(rt);
 }
 
@@ -1095,9 +1466,11 @@ static void initsock(void)
 Status *initstatus(Status *tmp)
 {
 	Status *s, *tail;
-	s = ecalloc(1, sizeof(Status));
+	s = poolget(&pools[POOL_STATUS]);
+	memcount(MEM_STATUS, 1, sizeof(Status));
 	if (tmp->path) {
 		size_t len = strlen(tmp->path) + 1;
+		memcount(MEM_STATUS, 0, len);
 		s->path = ecalloc(1, len);
 		strlcpy(s->path, tmp->path, len);
 	}
@@ -1134,6 +1507,8 @@ static void initwm(void)
 	sa.sa_flags = SA_RESTART;
 	for (i = 0; i < LEN(sigs); i++)
 		check(sigaction(sigs[i], &sa, NULL), "unable to setup signal handler");
+	for (i = 0; i < LEN(pools); i++)
+		poolgrow(&pools[i], prealloc[i]);
 	/* ignore SIGPIPE otherwise write() on broken pipes will crash and burn */
 	signal(SIGPIPE, SIG_IGN);
 
@@ -1155,8 +1530,9 @@ static void initwm(void)
 	}
 	if (randrbase < 0 || !nextmon(monitors))
 		initmon(0, "default", 0, 0, 0, scr_w, scr_h);
+	updmongrid();
 
-	cws = winprop(root, netatom[NET_DESK_CUR], &r) && r < 100 ? r : 0;
+	cws = winprop(root, netatom[NET_DESK_CUR], &r) && r < WS_MAX ? r : 0;
 	updworkspaces(MAX(cws + 1, globalcfg[GLB_WS_NUM].val));
 	selws = workspaces;
 	selmon = selws->mon;
@@ -1172,14 +1548,15 @@ static void initwm(void)
 	xcb_delete_property(con, root, netatom[NET_CLIENTS]);
 
 
-	uint32_t rm = monitors->next ? (rootmask | XCB_EVENT_MASK_POINTER_MOTION) : rootmask;
-	uint32_t val[] = { rm, cursor[CURS_NORMAL] };
+	rootcur = monitors->next ? (rootmask | XCB_EVENT_MASK_POINTER_MOTION) : rootmask;
+	uint32_t val[] = { rootcur, cursor[CURS_NORMAL] };
 	iferr(1, "unable to change root window event mask or cursor",
 			xcb_request_check(con, xcb_change_window_attributes_checked(con, root,
 					XCB_CW_EVENT_MASK | XCB_CW_CURSOR, &val)));
 
 	if (!(keysyms = xcb_key_symbols_alloc(con)))
 		err(1, "unable to get keysyms from X connection");
+	updlockmask();
 }
 
 static Workspace *initws(int num)
@@ -1187,6 +1564,7 @@ static Workspace *initws(int num)
 	Workspace *ws, *tail;
 
 	ws = ecalloc(1, sizeof(Workspace));
+	memcount(MEM_WS, 1, sizeof(Workspace));
 	ws->num = num;
 	itoa(num + 1, ws->name);
 	ws->gappx = MAX(0, wsdef.gappx);
@@ -1199,8 +1577,16 @@ static Workspace *initws(int num)
 	ws->padr = MAX(0, wsdef.padr);
 	ws->padt = MAX(0, wsdef.padt);
 	ws->padb = MAX(0, wsdef.padb);
+	ws->tiledirty = 1;
+	if (num >= wstabsz) {
+		int sz = MAX(num + 1, wstabsz * 2);
+		wstab = erealloc(wstab, sz * sizeof(Workspace *));
+		memset(wstab + wstabsz, 0, (sz - wstabsz) * sizeof(Workspace *));
+		wstabsz = sz;
+	}
+	wstab[num] = ws;
 	FIND_TAIL(tail, workspaces);
-	if (tail)
+	if ((ws->prev = tail))
 		tail->next = ws;
 	else
 		workspaces = ws;
@@ -1218,75 +1604,107 @@ Monitor *itomon(int num)
 
 Workspace *itows(int num)
 {
-	Workspace *ws = workspaces;
-
-	while (ws && ws->num != num)
-		ws = ws->next;
-	return ws;
+	return num >= 0 && num < wstabsz ? wstab[num] : NULL;
 }
 
 void manage(xcb_window_t win, int scan)
 {
+	WinFetch f;
+
+	switch (wintype(win, NULL)) {
+	case WIN_NONE: break;
+	case WIN_OVERRIDE: /* a map request means it's no longer override_redirect */
+		if (!scan) {
+			mapdel(&wintab, win);
+			break;
+		} /* FALLTHROUGH */
+	default: return;
+	}
+
+	/* everything needed to manage the window is requested at once so the
+	 * replies in managefetched() arrive together instead of one round trip each */
+	winfetch(win, &f, scan);
+	winfetchprops(win, &f);
+	managefetched(win, &f, scan);
+}
+
+static void managefetched(xcb_window_t win, WinFetch *f, int scan)
+{
+	xcb_generic_error_t *e;
+	xcb_atom_t type = XCB_NONE;
 	xcb_get_geometry_reply_t *g = NULL;
 	xcb_get_window_attributes_reply_t *wa = NULL;
-	xcb_atom_t type, state;
 
-	if (wintoclient(win) || wintopanel(win) || wintodesk(win)) return;
-	if (!(wa = winattr(win)) || !(g = wingeom(win))) goto end;
+	trace(TR_MANAGE, win, scan);
+	wa = f->wa ? f->wa : (PERF(PERF_REPLY), xcb_get_window_attributes_reply(con, f->attr, &e));
+	f->attr.sequence = 0;
+	if (!wa) {
+		iferr(0, "unable to get window attributes reply", e);
+		goto end;
+	}
+	PERF(PERF_REPLY);
+	g = xcb_get_geometry_reply(con, f->geom, &e);
+	f->geom.sequence = 0;
+	if (!g) {
+		iferr(0, "unable to get window geometry reply", e);
+		goto end;
+	}
 	DBG("manage: 0x%08x - %d,%d @ %dx%d", win, g->x, g->y, g->width, g->height)
-	if (winprop(win, netatom[NET_WM_TYPE], &type)) {
+	if (winpropreply(&f->type, &type)) {
 		DBG("manage: 0x%08x has NET_WM_TYPE", win);
 		if (type == netatom[NET_TYPE_DOCK])       initpanel(win, g);
 		else if (type == netatom[NET_TYPE_DESK])  initdesk(win, g);
 		else if (!wa->override_redirect)          goto client;
+		else mapset(&wintab, win, WIN_OVERRIDE, NULL);
 
 		/* never reached for normal windows, only panels, desktops, and override_redirect windows */
 		setwinstate(win, XCB_ICCCM_WM_STATE_NORMAL);
+		if (wintype(win, NULL) != WIN_OVERRIDE) netclientadd(win);
 
 	} else if (!wa->override_redirect) {
 client:
 		DBG("manage: 0x%08x has no NET_WM_TYPE", win);
 		/* TODO: this could be a problem for restart if we want to use the iconic state the client is never initialized */
-		if (scan && !(wa->map_state == XCB_MAP_STATE_VIEWABLE
-					|| (winprop(win, wmatom[WM_STATE], &state) && state == XCB_ICCCM_WM_STATE_ICONIC)))
+		if (!f->props) /* initscan() only fetched viewable and iconic windows */
 			goto end;
 
-		initclient(win, g);
-		PROP(APPEND, root, netatom[NET_CLIENTS], XCB_ATOM_WINDOW, 32, 1, &win);
+		initclient(win, g, f, type);
+		if (wintoclient(win))
+			netclientadd(win);
+	} else {
+		mapset(&wintab, win, WIN_OVERRIDE, NULL);
+		goto end;
 	}
 	needsrefresh = 1;
 end:
+	winfetchdone(f);
 	free(wa);
 	free(g);
 }
 
 void movestack(int direction)
 {
-	Client *c = cmdc, *t;
+	int i;
+	Client *c = cmdc, *t, **tl;
 
-	if (!nexttiled(c->ws->clients->next)) return;
+	if (tilecount(c->ws) <= 1) return;
 	if (direction > 0) {
 		while (direction) {
-			detach(c, (t = nexttiled(c->next)) ? 0 : 1);
-			if (t) ATTACH(c, t->next);
+			tl = tiled(c->ws);
+			detach(c, (t = tl[c->tidx + 1]) ? 0 : 1);
+			if (t) attachafter(c, t);
 			direction--;
 		}
 	} else {
-		int i;
 		while (direction) {
-			if (c == nexttiled(c->ws->clients)) {
+			tl = tiled(c->ws);
+			if (!(i = c->tidx)) {
 				detach(c, 0);
 				attach(c, 0);
 			} else {
-				for (t = nexttiled(c->ws->clients); t && nexttiled(t->next)
-						&& nexttiled(t->next) != c; t = nexttiled(t->next))
-					;
-				detach(c, (i = (t == nexttiled(c->ws->clients)) ? 1 : 0));
-				if (!i) {
-					c->next = t;
-					FIND_PREV(t, c->next, c->ws->clients);
-					t->next = c;
-				}
+				t = tl[i - 1];
+				detach(c, i == 1);
+				if (i != 1) attachafter(c, t->prev);
 			}
 			direction++;
 		}
@@ -1294,6 +1712,68 @@ void movestack(int direction)
 	needsrefresh = 1;
 }
 
+static double mssince(struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1000.0 + (t1.tv_nsec - t0->tv_nsec) / 1000000.0;
+}
+
+static void netclientadd(xcb_window_t win)
+{
+	if (nnetclients == netclientssz)
+		netclients = erealloc(netclients, (netclientssz = netclientssz ? netclientssz * 2 : 64) * sizeof(xcb_window_t));
+	netclients[nnetclients++] = win;
+	netclientsdirty = 1;
+}
+
+static void netclientdel(xcb_window_t win)
+{
+	/* _NET_CLIENT_LIST is in mapping order so keep it */
+	for (unsigned int i = 0; i < nnetclients; i++)
+		if (netclients[i] == win) {
+			memmove(netclients + i, netclients + i + 1, (--nnetclients - i) * sizeof(xcb_window_t));
+			netclientsdirty = 1;
+			return;
+		}
+}
+
+static void netflush(void)
+{
+	unsigned int n = 0;
+	uint32_t v[2];
+	Workspace *ws;
+
+	if (netclientsdirty) {
+		PROP(REPLACE, root, netatom[NET_CLIENTS], XCB_ATOM_WINDOW, 32, nnetclients, netclients);
+		netclientsdirty = 0;
+	}
+	if (netwsdirty) {
+		FOR_EACH(ws, workspaces) n++;
+		if (n * 4 > netwsgeomsz)
+			netwsgeom = erealloc(netwsgeom, (netwsgeomsz = n * 4) * sizeof(uint32_t));
+		v[0] = scr_w, v[1] = scr_h;
+		PROP(REPLACE, root, netatom[NET_DESK_GEOM], XCB_ATOM_CARDINAL, 32, 2, &v);
+		PROP(REPLACE, root, netatom[NET_DESK_NUM], XCB_ATOM_CARDINAL, 32, 1, &globalcfg[GLB_WS_NUM]);
+		n = 0;
+		FOR_EACH(ws, workspaces) {
+			netwsgeom[n++] = ws->mon->x;
+			netwsgeom[n++] = ws->mon->y;
+		}
+		PROP(REPLACE, root, netatom[NET_DESK_VP], XCB_ATOM_CARDINAL, 32, n, netwsgeom);
+		n = 0;
+		FOR_EACH(ws, workspaces) {
+			netwsgeom[n++] = ws->mon->wx;
+			netwsgeom[n++] = ws->mon->wy;
+			netwsgeom[n++] = ws->mon->ww;
+			netwsgeom[n++] = ws->mon->wh;
+		}
+		PROP(REPLACE, root, netatom[NET_DESK_WA], XCB_ATOM_CARDINAL, 32, n, netwsgeom);
+		netwsdirty = 0;
+	}
+}
+
 Monitor *nextmon(Monitor *m)
 {
 	while (m && !m->connected)
@@ -1303,7 +1783,7 @@ Monitor *nextmon(Monitor *m)
 
 Client *nexttiled(Client *c)
 {
-	while (c && FLOATING(c))
+	while (c && (FLOATING(c) || c->state & STATE_WITHDRAWING))
 		c = c->next;
 	return c;
 }
@@ -1323,6 +1803,7 @@ void popfloat(Client *c)
 	int x, y, w, h;
 
 	c->state |= STATE_FLOATING;
+	RETILE(c);
 	x = c->x, y = c->y;
 	w = CLAMP(c->w, c->ws->mon->ww / 8, c->ws->mon->ww / 3);
 	h = CLAMP(c->h, c->ws->mon->wh / 8, c->ws->mon->wh / 3);
@@ -1332,7 +1813,6 @@ void popfloat(Client *c)
 	for (c = c->ws->stack; c; c = c->snext)
 		if (c->state & STATE_ABOVE && ((c->state & STATE_FLOATING) || c->ws->layout->func == NULL))
 			setstackmode(c->win, XCB_STACK_MODE_ABOVE);
-	xcb_aux_sync(con);
 }
 
 void printstatus(Status *s, int freeable)
@@ -1379,6 +1859,18 @@ void printstatus(Status *s, int freeable)
 					selws->layout->name,
 					selws->sel && !(selws->sel->state & STATE_HIDDEN) ? selws->sel->title :"");
 			break;
+		case STAT_PERF:
+			perfprint(s->file);
+			break;
+		case STAT_TRACE:
+			traceprint(s->file);
+			break;
+		case STAT_LATENCY:
+			latprint(s->file);
+			break;
+		case STAT_MEM:
+			memprint(s->file);
+			break;
 		case STAT_FULL:
 			/* Globals */
 			fprintf(s->file, "# globals - key: value ...\n"
@@ -1545,6 +2037,21 @@ void printstatus(Status *s, int freeable)
 							p->b);
 			}
 
+			/* Pools */
+			fprintf(s->file, "\n\n# type:live:free ...\npools:");
+			for (unsigned int i = 0; i < LEN(pools); i++)
+				fprintf(s->file, " %s:%u:%u", poolnames[i], pools[i].live, pools[i].free);
+
+			/* Property writes */
+			fprintf(s->file, "\n\n# skipped\nwrites: %u", wroteskip);
+
+			/* Startup scan */
+			fprintf(s->file, "\n\n# windows milliseconds\nscan: %u %.3f", scanwins, scanms);
+
+			/* Workspace switches */
+			fprintf(s->file, "\n\n# count last max average (milliseconds)\nswitch: %u %.3f %.3f %.3f",
+					wsswitches, wsswitchlast, wsswitchmax, wsswitches ? wsswitchtotal / wsswitches : 0.0);
+
 			break;
 		}
 		fflush(s->file);
@@ -1594,18 +2101,23 @@ static int refresh(void)
 	Client *c;
 	Monitor *m;
 
+	trace(TR_REFRESH, 0, 0);
 #define MAP(v, list)                                        \
 	FOR_EACH(v, list)                                       \
 		if (v->state & STATE_NEEDSMAP) {                    \
 			v->state &= ~STATE_NEEDSMAP;                    \
 			setwinstate(v->win, XCB_ICCCM_WM_STATE_NORMAL); \
+			PERF(PERF_REQUEST);                             \
 			xcb_map_window(con, v->win);                    \
 		}
 
 	if (panels) MAP(p, panels)
 	if (desks) MAP(d, desks)
 	FOR_EACH(m, monitors) {
-		if (m->ws->layout->func) m->ws->layout->func(m->ws);
+		if (m->ws->layout->func) {
+			trace(TR_LAYOUT, 0, m->ws->num);
+			m->ws->layout->func(m->ws);
+		}
 		FOR_EACH(c, m->ws->clients) {
 			if (c->state & STATE_NEEDSMAP)
 				clientmap(c);
@@ -1616,7 +2128,6 @@ static int refresh(void)
 		restack(m->ws);
 	}
 	ignore(XCB_ENTER_NOTIFY);
-	xcb_aux_sync(con);
 
 	DBG("refresh: focusing first client: %s", selws->sel ? selws->sel->title : "NONE")
 	focus(NULL);
@@ -1697,7 +2208,7 @@ void restack(Workspace *ws)
 {
 	Desk *d;
 	Panel *p;
-	Client *c;
+	Client *c, *t;
 
 	if (!ws || !(c = ws->sel)) return;
 
@@ -1713,16 +2224,32 @@ void restack(Workspace *ws)
 	FOR_EACH(d, desks)
 		if (d->mon == ws->mon)
 			setstackmode(d->win, XCB_STACK_MODE_BELOW);
-	for (c = ws->stack; c; c = c->snext)
-		if ((c->state & STATE_ABOVE && ((c->state & STATE_FLOATING) || c->ws->layout->func == NULL))
-				|| (c->trans && FULLSCREEN(c->trans)))
+	for (c = ws->stack; c; c = c->snext) {
+		if (c->state & STATE_ABOVE && ((c->state & STATE_FLOATING) || c->ws->layout->func == NULL))
 			setstackmode(c->win, XCB_STACK_MODE_ABOVE);
+		if (FULLSCREEN(c))
+			for (t = c->tchild; t; t = t->tnext)
+				if (t->ws == ws)
+					setstackmode(t->win, XCB_STACK_MODE_ABOVE);
+	}
+}
+
+static int rulematch(regex_t *reg, const char *str, const char **seen, int *hit)
+{
+	/* str is interned so an unchanged pointer means an unchanged string,
+	 * holding a reference on it keeps the address from being reused */
+	if (str != *seen) {
+		strrelease(*seen);
+		*seen = strretain(str);
+		*hit = !regexec(reg, str, 0, NULL, 0);
+	}
+	return *hit;
 }
 
 static int rulecmp(Client *c, Rule *r)
 {
-	return !((r->class && regexec(&(r->classreg), c->class, 0, NULL, 0))
-			|| (r->inst && regexec(&(r->instreg), c->inst, 0, NULL, 0))
+	return !((r->class && !rulematch(&(r->classreg), c->class, &r->classseen, &r->classhit))
+			|| (r->inst && !rulematch(&(r->instreg), c->inst, &r->instseen, &r->insthit))
 			|| (r->title && regexec(&(r->titlereg), c->title, 0, NULL, 0)));
 }
 
@@ -1740,24 +2267,14 @@ void sendconfigure(Client *c)
 		.above_sibling = XCB_NONE,
 		.override_redirect = 0,
 	};
+	PERF(PERF_REQUEST);
 	xcb_send_event(con, 0, c->win, XCB_EVENT_MASK_STRUCTURE_NOTIFY, (char *)&e);
 }
 
 int sendwmproto(Client *c, int wmproto)
 {
-	int exists = 0;
-	xcb_generic_error_t *er;
-	xcb_get_property_cookie_t rpc;
-	xcb_icccm_get_wm_protocols_reply_t proto;
+	int exists = c->protos & (1 << wmproto);
 
-	rpc = xcb_icccm_get_wm_protocols(con, c->win, wmatom[WM_PROTO]);
-	if (xcb_icccm_get_wm_protocols_reply(con, rpc, &proto, &er)) {
-		int n = proto.atoms_len;
-		while (!exists && n--) exists = proto.atoms[n] == wmatom[wmproto];
-		xcb_icccm_get_wm_protocols_reply_wipe(&proto);
-	} else {
-		iferr(0, "unable to get requested wm protocol", er);
-	}
 	if (exists) {
 		xcb_client_message_event_t e = {
 			.response_type = XCB_CLIENT_MESSAGE,
@@ -1767,8 +2284,9 @@ int sendwmproto(Client *c, int wmproto)
 			.data.data32[0] = wmatom[wmproto],
 			.data.data32[1] = XCB_TIME_CURRENT_TIME
 		};
-		iferr(0, "unable to send client message event", xcb_request_check(con,
-					xcb_send_event_checked(con, 0, c->win, XCB_EVENT_MASK_NO_EVENT, (char *)&e)));
+		PERF(PERF_REQUEST);
+		checklater(xcb_send_event_checked(con, 0, c->win, XCB_EVENT_MASK_NO_EVENT, (char *)&e),
+				0, "unable to send client message event");
 	}
 	return exists;
 }
@@ -1776,21 +2294,22 @@ int sendwmproto(Client *c, int wmproto)
 void setfullscreen(Client *c, int fullscreen)
 {
 	Monitor *m;
-	xcb_atom_t state = netatom[NET_WM_STATE];
 
 	if (!c->ws || !(m = c->ws->mon)) m = selws->mon;
 	if (fullscreen && !(c->state & STATE_FULLSCREEN)) {
-		PROP(REPLACE, c->win, state, XCB_ATOM_ATOM, 32, 1, &netatom[NET_STATE_FULL]);
+		setnetstate(c->win, STATE_FULLSCREEN);
 		c->old_state = c->state;
 		c->state |= STATE_FULLSCREEN | STATE_FLOATING | STATE_NOBORDER;
+		RETILE(c);
 		c->old_bw = c->bw;
 		c->bw = 0;
 		resize(c, m->x, m->y, m->w, m->h, 0);
 		setstackmode(c->win, XCB_STACK_MODE_ABOVE);
 		needsrefresh = 1;
 	} else if (!fullscreen && (c->state & STATE_FULLSCREEN)) {
-		PROP(REPLACE, c->win, state, XCB_ATOM_ATOM, 32, 0, (const void *)0);
+		setnetstate(c->win, 0);
 		c->state = c->old_state;
+		RETILE(c);
 		c->bw = c->old_bw;
 		resize(c, c->old_x, c->old_y, c->old_w, c->old_h, c->bw);
 		needsrefresh = 1;
@@ -1800,8 +2319,9 @@ void setfullscreen(Client *c, int fullscreen)
 void setinputfocus(Client *c)
 {
 	if (!(c->state & STATE_NOINPUT)) {
+		PERF(PERF_REQUEST);
 		xcb_set_input_focus(con, XCB_INPUT_FOCUS_POINTER_ROOT, c->win, XCB_CURRENT_TIME);
-		PROP(REPLACE, root, netatom[NET_ACTIVE], XCB_ATOM_WINDOW, 32, 1, &c->win);
+		setnetactive(c->win);
 	}
 	sendwmproto(c, WM_FOCUS);
 }
@@ -1831,13 +2351,55 @@ void setstackmode(xcb_window_t win, uint32_t mode)
 	else
 		DBG("setstackmode: stacking window %s: 0x%08x", mode == XCB_STACK_MODE_ABOVE ? "above" : "below", win)
 #endif
+	PERF(PERF_REQUEST);
 	xcb_configure_window(con, win, XCB_CONFIG_WINDOW_STACK_MODE, &mode);
 }
 
+void settrans(Client *c, Client *trans)
+{
+	Client **cc;
+
+	if (trans == c) trans = NULL;
+	if (c->trans == trans) return;
+	if (c->trans) {
+		for (cc = &c->trans->tchild; *cc && *cc != c; cc = &(*cc)->tnext)
+			;
+		if (*cc) *cc = c->tnext;
+	}
+	if ((c->trans = trans)) {
+		c->tnext = trans->tchild;
+		trans->tchild = c;
+	} else {
+		c->tnext = NULL;
+	}
+}
+
+static void setnetactive(xcb_window_t win)
+{
+	/* XCB_WINDOW_NONE deletes the property */
+	if (netactiveset && netactive == win) {
+		wroteskip++;
+		return;
+	}
+	netactiveset = 1;
+	if ((netactive = win))
+		PROP(REPLACE, root, netatom[NET_ACTIVE], XCB_ATOM_WINDOW, 32, 1, &win);
+	else
+		PERF(PERF_REQUEST), xcb_delete_property(con, root, netatom[NET_ACTIVE]);
+}
+
+void setnetdesk(Client *c, uint32_t desk)
+{
+	if (!wrote(c, WROTE_DESK, desk))
+		PROP(REPLACE, c->win, netatom[NET_WM_DESK], XCB_ATOM_CARDINAL, 32, 1, &desk);
+}
+
 void setnetstate(xcb_window_t win, uint32_t state)
 {
-#ifdef DEBUG
 	Client *c = wintoclient(win);
+
+	if (c && wrote(c, WROTE_NETSTATE, state & STATE_FULLSCREEN)) return;
+#ifdef DEBUG
 	if (c)
 		DBG("setnetstate: window %s: %s", c->title, (state & STATE_FULLSCREEN) ? "fullscreen" : "none")
 	else
@@ -1853,29 +2415,30 @@ void setnetstate(xcb_window_t win, uint32_t state)
 
 void seturgent(Client *c, int urg)
 {
-	xcb_generic_error_t *e;
-	xcb_icccm_wm_hints_t wmh;
-	xcb_get_property_cookie_t pc;
+	int32_t flags;
 
-	pc = xcb_icccm_get_wm_hints(con, c->win);
 	if (urg && c != selws->sel)
 		c->state |= STATE_URGENT;
 	else if (!urg)
 		c->state &= ~STATE_URGENT;
-	if (xcb_icccm_get_wm_hints_reply(con, pc, &wmh, &e)) {
-		wmh.flags = urg
-			? (wmh.flags | XCB_ICCCM_WM_HINT_X_URGENCY)
-			: (wmh.flags & ~XCB_ICCCM_WM_HINT_X_URGENCY);
-		xcb_icccm_set_wm_hints(con, c->win, &wmh);
-	} else {
-		iferr(0, "unable to get wm window hints", e);
+	if (c->haswmh) {
+		flags = urg
+			? (c->wmh.flags | XCB_ICCCM_WM_HINT_X_URGENCY)
+			: (c->wmh.flags & ~XCB_ICCCM_WM_HINT_X_URGENCY);
+		if (flags != c->wmh.flags) {
+			c->wmh.flags = flags;
+			PERF(PERF_REQUEST);
+			xcb_icccm_set_wm_hints(con, c->win, &c->wmh);
+		}
 	}
 }
 
 void setwinstate(xcb_window_t win, uint32_t state)
 {
-#ifdef DEBUG
 	Client *c = wintoclient(win);
+
+	if (c && wrote(c, WROTE_WMSTATE, state)) return;
+#ifdef DEBUG
 	if (c)
 		DBG("setwinstate: window %s: %s", c->title, state == XCB_ICCCM_WM_STATE_NORMAL ? "NORMAL" : "WITHDRAWN")
 	else
@@ -1888,7 +2451,6 @@ void setwinstate(xcb_window_t win, uint32_t state)
 void setworkspace(Client *c, int num, int stacktail)
 {
 	Workspace *ws;
-	Client *tail = NULL;
 
 	/* TODO: why are we using itows here rather than the caller, this would also be better for error handling */
 	if (!(ws = itows(num)) || ws == c->ws) return;
@@ -1898,13 +2460,13 @@ void setworkspace(Client *c, int num, int stacktail)
 		detachstack(c);
 	}
 	c->ws = ws;
-	PROP(REPLACE, c->win, netatom[NET_WM_DESK], XCB_ATOM_CARDINAL, 32, 1, &c->ws->num);
+	setnetdesk(c, ws->num);
 	attach(c, globalcfg[GLB_TILE_TOHEAD].val);
-	if (stacktail)
-		for (tail = ws->stack; tail && tail->snext; tail = tail->snext);
-	if (tail) {
-		tail->snext = c;
+	if (stacktail && ws->stail) {
 		c->snext = NULL;
+		c->sprev = ws->stail;
+		ws->stail->snext = c;
+		ws->stail = c;
 	} else {
 		attachstack(c);
 	}
@@ -1945,16 +2507,23 @@ void showhide(Client *c)
 }
 
 void sizehints(Client *c, int uss)
+{
+	xcb_get_property_cookie_t ck = xcb_icccm_get_wm_normal_hints(con, c->win);
+
+	PERF(PERF_REQUEST);
+	sizehintsreply(c, &ck, uss);
+}
+
+static void sizehintsreply(Client *c, xcb_get_property_cookie_t *ck, int uss)
 {
 	xcb_size_hints_t s;
 	xcb_generic_error_t *e;
-	xcb_get_property_cookie_t pc;
 
-	pc = xcb_icccm_get_wm_normal_hints(con, c->win);
 	c->inc_w = c->inc_h = 0;
 	c->max_aspect = c->min_aspect = 0.0;
 	c->min_w = c->min_h = c->max_w = c->max_h = c->base_w = c->base_h = 0;
-	if (xcb_icccm_get_wm_normal_hints_reply(con, pc, &s, &e)) {
+	PERF(PERF_REPLY);
+	if (xcb_icccm_get_wm_normal_hints_reply(con, *ck, &s, &e)) {
 		if (uss && s.flags & XCB_ICCCM_SIZE_HINT_US_SIZE)
 			c->w = s.width, c->h = s.height;
 		if (uss && s.flags & XCB_ICCCM_SIZE_HINT_US_POSITION)
@@ -1978,50 +2547,92 @@ void sizehints(Client *c, int uss)
 	} else {
 		iferr(0, "unable to get wm normal hints", e);
 	}
-	if (c->max_w && c->max_w == c->min_w && c->max_h && c->max_h == c->min_h)
+	ck->sequence = 0;
+	if (c->max_w && c->max_w == c->min_w && c->max_h && c->max_h == c->min_h) {
 		c->state |= STATE_FIXED | STATE_FLOATING;
+		RETILE(c);
+	}
 	c->hints = 1;
 }
 
 int tilecount(Workspace *ws)
 {
-	int i;
-	Client *c;
+	tiled(ws);
+	return ws->layout->func ? ws->ntiled : 0;
+}
 
-	for (i = 0, c = nexttiled(ws->clients); c; c = nexttiled(c->next), i++);
-	return i;
+Client **tiled(Workspace *ws)
+{
+	int n;
+	Client *c;
+	static Client *none = NULL;
+
+	if (ws->tiledirty) {
+		for (n = 0, c = ws->clients; c; c = c->next)
+			n += !(c->state & (STATE_FLOATING | STATE_WITHDRAWING));
+		if (n + 1 > ws->tiledsz) {
+			memcount(MEM_WS, 0, (n + 1 - ws->tiledsz) * sizeof(Client *));
+			ws->tiled = erealloc(ws->tiled, (ws->tiledsz = n + 1) * sizeof(Client *));
+		}
+		for (n = 0, c = ws->clients; c; c = c->next) {
+			c->tidx = -1;
+			if (!(c->state & (STATE_FLOATING | STATE_WITHDRAWING)))
+				ws->tiled[(c->tidx = n++)] = c;
+		}
+		ws->tiled[n] = NULL;
+		ws->ntiled = n;
+		ws->tiledirty = 0;
+	}
+	/* with no layout function every client is floating */
+	return ws->layout->func ? ws->tiled : &none;
 }
 
 void unfocus(Client *c, int focusroot)
 {
 	if (c) clientborder(c, 0);
 	if (focusroot) {
+		PERF(PERF_REQUEST);
 		xcb_set_input_focus(con, XCB_INPUT_FOCUS_POINTER_ROOT, root, XCB_CURRENT_TIME);
-		xcb_delete_property(con, root, netatom[NET_ACTIVE]);
+		setnetactive(XCB_WINDOW_NONE);
 	}
 }
 
 void unmanage(xcb_window_t win, int destroyed)
 {
 	Desk *d;
-	Panel *p;
-	Client *c;
+	Panel *p = NULL;
 	void *ptr;
-	Workspace *ws;
-
-	if ((ptr = c = wintoclient(win))) {
+	Client *c = NULL;
+	Pool *pool = NULL;
+
+	trace(TR_UNMANAGE, win, destroyed);
+	switch (wintype(win, &ptr)) {
+	case WIN_CLIENT:
+		c = ptr;
+		pool = &pools[POOL_CLIENT];
+		settrans(c, NULL);
+		while (c->tchild)
+			settrans(c->tchild, NULL);
 		if (c->cb && running) c->cb->func(c, 1);
 		wschange = c->ws->clients->next ? wschange : 1;
 		detach(c, 0);
 		detachstack(c);
-	} else if ((ptr = p = wintopanel(win))) {
+		break;
+	case WIN_PANEL:
+		p = ptr;
+		pool = &pools[POOL_PANEL];
 		Panel **pp = &panels;
 		DETACH(p, pp);
 		updstruts();
-	} else if ((ptr = d = wintodesk(win))) {
+		break;
+	case WIN_DESK:
+		d = ptr;
+		pool = &pools[POOL_DESK];
 		Desk **dd = &desks;
 		DETACH(d, dd);
+		break;
 	}
+	mapdel(&wintab, win);
 
 	if (!destroyed) {
 		xcb_grab_server(con);
@@ -2034,39 +2645,88 @@ void unmanage(xcb_window_t win, int destroyed)
 			}
 		}
 		setwinstate(win, XCB_ICCCM_WM_STATE_WITHDRAWN);
-		xcb_aux_sync(con);
 		xcb_ungrab_server(con);
-	} else {
-		xcb_aux_sync(con);
 	}
 
-	if (ptr) {
-		free(ptr);
-		xcb_delete_property(con, root, netatom[NET_CLIENTS]);
-		FOR_CLIENTS(c, ws)  PROP(APPEND, root, netatom[NET_CLIENTS], XCB_ATOM_WINDOW, 32, 1, &c->win);
-		FOR_EACH(p, panels) PROP(APPEND, root, netatom[NET_CLIENTS], XCB_ATOM_WINDOW, 32, 1, &p->win);
-		FOR_EACH(d, desks)  PROP(APPEND, root, netatom[NET_CLIENTS], XCB_ATOM_WINDOW, 32, 1, &d->win);
+	if (pool) {
+		if (c) {
+			strrelease(c->class);
+			strrelease(c->inst);
+			memcount(MEM_CLIENT, -1, -(long)(sizeof(Client) + c->titlesz));
+			arenafree(&titles, c->title, c->titlesz);
+		} else if (p) {
+			strrelease(p->class);
+			strrelease(p->inst);
+			memcount(MEM_PANEL, -1, -(long)sizeof(Panel));
+		} else {
+			memcount(MEM_DESK, -1, -(long)sizeof(Desk));
+		}
+		poolput(pool, ptr);
+		netclientdel(win);
 		needsrefresh = 1;
 	}
 }
 
+static void unmapbegin(void)
+{
+	/* dk's own unmaps must not generate unmap notifies on the root */
+	uint32_t rm = (rootcur & ~XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY);
+
+	if (unmapping++) return;
+	xcb_grab_server(con);
+	xcb_change_window_attributes(con, root, XCB_CW_EVENT_MASK, &rm);
+}
+
+static void unmapend(void)
+{
+	if (--unmapping) return;
+	xcb_change_window_attributes(con, root, XCB_CW_EVENT_MASK, &rootcur);
+	xcb_ungrab_server(con);
+}
+
+static void updmongrid(void)
+{
+	Monitor *m;
+	int i, j, n = 0;
+
+	FOR_EACH(m, monitors)
+		n += m->connected;
+	monx = erealloc(monx, ((2 * n) + 1) * sizeof(int));
+	mony = erealloc(mony, ((2 * n) + 1) * sizeof(int));
+	nmonx = nmony = 0;
+	FOR_EACH(m, monitors)
+		if (m->connected) {
+			monx[nmonx++] = m->x, monx[nmonx++] = m->x + m->w;
+			mony[nmony++] = m->y, mony[nmony++] = m->y + m->h;
+		}
+	nmonx = edgesort(monx, nmonx);
+	nmony = edgesort(mony, nmony);
+	moncell = erealloc(moncell, (MAX(1, (nmonx - 1) * (nmony - 1))) * sizeof(Monitor *));
+
+	/* every point of a cell is inside the same set of monitors, so the first
+	 * monitor holding the top left corner matches what a linear scan would give */
+	for (j = 0; j < nmony - 1; j++)
+		for (i = 0; i < nmonx - 1; i++) {
+			moncell[(j * (nmonx - 1)) + i] = NULL;
+			FOR_EACH(m, monitors)
+				if (m->connected && monx[i] >= m->x && monx[i] < m->x + m->w
+						&& mony[j] >= m->y && mony[j] < m->y + m->h)
+				{
+					moncell[(j * (nmonx - 1)) + i] = m;
+					break;
+				}
+		}
+	hitx = hity = -1;
+}
+
 static void updnetworkspaces(void)
 {
-	int v[4];
+	/* written by netflush() */
 	Workspace *ws;
 
-	xcb_delete_property(con, root, netatom[NET_DESK_VP]);
-	xcb_delete_property(con, root, netatom[NET_DESK_WA]);
-	v[0] = scr_w, v[1] = scr_h;
-	PROP(REPLACE, root, netatom[NET_DESK_GEOM], XCB_ATOM_CARDINAL, 32, 2, &v);
-	PROP(REPLACE, root, netatom[NET_DESK_NUM], XCB_ATOM_CARDINAL, 32, 1, &globalcfg[GLB_WS_NUM]);
-	FOR_EACH(ws, workspaces) {
+	FOR_EACH(ws, workspaces)
 		if (!ws->mon) ws->mon = primary;
-		v[0] = ws->mon->x, v[1] = ws->mon->y;
-		PROP(APPEND, root, netatom[NET_DESK_VP], XCB_ATOM_CARDINAL, 32, 2, &v);
-		v[0] = ws->mon->wx, v[1] = ws->mon->wy, v[2] = ws->mon->ww, v[3] = ws->mon->wh;
-		PROP(APPEND, root, netatom[NET_DESK_WA], XCB_ATOM_CARDINAL, 32, 4, &v);
-	}
+	netwsdirty = 1;
 }
 
 static int updoutputs(xcb_randr_output_t *outs, int nouts, xcb_timestamp_t t)
@@ -2135,6 +2795,7 @@ next:
 	}
 
 	if (changed) {
+		updmongrid();
 		pc = xcb_randr_get_output_primary(con, root);
 		if (!(po = xcb_randr_get_output_primary_reply(con, pc, NULL))
 				|| !(primary = outputtomon(po->output)))
@@ -2170,8 +2831,8 @@ int updrandr(int init)
 			changed = updoutputs(xcb_randr_get_screen_resources_outputs(r), n, r->config_timestamp);
 
 		if (!init) {
-			uint32_t rm = monitors->next ? (rootmask | XCB_EVENT_MASK_POINTER_MOTION) : rootmask;
-			xcb_change_window_attributes(con, root, XCB_CW_EVENT_MASK, &rm);
+			rootcur = monitors->next ? (rootmask | XCB_EVENT_MASK_POINTER_MOTION) : rootmask;
+			xcb_change_window_attributes(con, root, XCB_CW_EVENT_MASK, &rootcur);
 		}
 
 		free(r);
@@ -2181,6 +2842,30 @@ int updrandr(int init)
 	return changed;
 }
 
+void updlockmask(void)
+{
+	/* numlock rarely moves, only recompute on startup and mapping notify */
+	xcb_generic_error_t *e;
+	xcb_get_modifier_mapping_reply_t *m = NULL;
+
+	lockmask = 0;
+	if ((m = xcb_get_modifier_mapping_reply(con, xcb_get_modifier_mapping(con), &e))) {
+		xcb_keycode_t *k, *t = NULL;
+		if ((t = xcb_key_symbols_get_keycode(keysyms, 0xff7f))
+				&& (k = xcb_get_modifier_mapping_keycodes(m)))
+		{
+			for (unsigned int i = 0; i < 8; i++)
+				for (unsigned int j = 0; j < m->keycodes_per_modifier; j++)
+					if (k[i * m->keycodes_per_modifier + j] == *t)
+						lockmask = (1 << i);
+		}
+		free(t);
+	} else {
+		iferr(0, "unable to get modifier mapping for numlock", e);
+	}
+	free(m);
+}
+
 void updstruts(void)
 {
 	Panel *p;
@@ -2210,8 +2895,11 @@ void updworkspaces(int needed)
 
 	for (n = 0, m = nextmon(monitors); m; m = nextmon(m->next), n++)
 		;
-	if (n < 1 || n > 99 || needed > 99) {
-		warnx(n < 1 ? "no connected monitors" : "allocating too many workspaces: max 99");
+	if (n < 1 || n > WS_MAX || needed > WS_MAX) {
+		if (n < 1)
+			warnx("no connected monitors");
+		else
+			warnx("allocating too many workspaces: max %d", WS_MAX);
 		return;
 	}
 	while (n > globalcfg[GLB_WS_NUM].val || needed > globalcfg[GLB_WS_NUM].val) {
@@ -2237,28 +2925,31 @@ void updworkspaces(int needed)
 	needsrefresh = 1;
 }
 
-static xcb_get_window_attributes_reply_t *winattr(xcb_window_t win)
+static void winclass(xcb_window_t win, const char **class, const char **inst)
 {
-	xcb_generic_error_t *e;
-	xcb_get_window_attributes_reply_t *wa = NULL;
+	xcb_get_property_cookie_t ck = xcb_icccm_get_wm_class(con, win);
 
-	GET(win, wa, e, "attributes", window_attributes);
-	return wa;
+	PERF(PERF_REQUEST);
+	winclassreply(&ck, class, inst);
 }
 
-static void winclass(xcb_window_t win, char *class, char *inst, size_t len)
+static void winclassreply(xcb_get_property_cookie_t *ck, const char **class, const char **inst)
 {
-	/* it is assumed that class and inst are allocated and the same size (char [64] in this case) */
+	/* class and inst are set to interned strings, the caller releases them */
+	int ok;
 	xcb_generic_error_t *e;
 	xcb_icccm_get_wm_class_reply_t p;
 
-	if (!xcb_icccm_get_wm_class_reply(con, xcb_icccm_get_wm_class(con, win), &p, &e)) {
+	PERF(PERF_REPLY);
+	ok = xcb_icccm_get_wm_class_reply(con, *ck, &p, &e);
+	ck->sequence = 0;
+	if (!ok) {
 		iferr(0, "unable to get window class", e);
-		if (class) strlcpy(class, "broken", len);
-		if (inst) strlcpy(inst, "broken", len);
+		*class = strintern("broken");
+		*inst = strintern("broken");
 	} else {
-		if (class) strlcpy(class, strlen(p.class_name) ? p.class_name : "broken", len);
-		if (inst) strlcpy(inst, strlen(p.instance_name) ? p.instance_name : "broken", len);
+		*class = strintern(strlen(p.class_name) ? p.class_name : "broken");
+		*inst = strintern(strlen(p.instance_name) ? p.instance_name : "broken");
 		xcb_icccm_get_wm_class_reply_wipe(&p);
 	}
 }
@@ -2272,94 +2963,142 @@ static xcb_get_geometry_reply_t *wingeom(xcb_window_t win)
 	return g;
 }
 
+static void winfetch(xcb_window_t win, WinFetch *f, int scan)
+{
+	/* what's needed to decide whether the window is managed at all */
+	memset(f, 0, sizeof(WinFetch));
+	PERFN(PERF_REQUEST, scan ? 4 : 3);
+	f->attr = xcb_get_window_attributes(con, win);
+	f->geom = xcb_get_geometry(con, win);
+	f->type = xcb_get_property(con, 0, win, netatom[NET_WM_TYPE], XCB_ATOM_ANY, 0, 1);
+	if (scan)
+		f->wmstate = xcb_get_property(con, 0, win, wmatom[WM_STATE], XCB_ATOM_ANY, 0, 1);
+}
+
+static void winfetchdone(WinFetch *f)
+{
+	/* replies that were never needed, panels, desktops, broken windows etc. */
+	unsigned int seq[] = {
+		f->attr.sequence, f->geom.sequence, f->type.sequence, f->state.sequence,
+		f->desk.sequence, f->wmstate.sequence, f->class.sequence, f->trans.sequence,
+		f->motif.sequence, f->netname.sequence, f->wmname.sequence, f->normal.sequence,
+		f->hints.sequence, f->proto.sequence
+	};
+
+	for (unsigned int i = 0; i < LEN(seq); i++)
+		if (seq[i]) xcb_discard_reply(con, seq[i]);
+}
+
+static void winfetchprops(xcb_window_t win, WinFetch *f)
+{
+#define PROPREQ(atom) xcb_get_property(con, 0, win, atom, XCB_ATOM_ANY, 0, 1)
+	PERFN(PERF_REQUEST, 10);
+	f->state = PROPREQ(netatom[NET_WM_STATE]);
+	f->desk = PROPREQ(netatom[NET_WM_DESK]);
+	f->class = xcb_icccm_get_wm_class(con, win);
+	f->trans = xcb_icccm_get_wm_transient_for(con, win);
+	f->motif = xcb_get_property(con, 0, win, wmatom[WM_MOTIF], wmatom[WM_MOTIF], 0, 5);
+	f->netname = xcb_icccm_get_text_property(con, win, netatom[NET_WM_NAME]);
+	f->wmname = xcb_icccm_get_text_property(con, win, XCB_ATOM_WM_NAME);
+	f->normal = xcb_icccm_get_wm_normal_hints(con, win);
+	f->hints = xcb_icccm_get_wm_hints(con, win);
+	f->proto = xcb_icccm_get_wm_protocols(con, win, wmatom[WM_PROTO]);
+	f->props = 1;
+#undef PROPREQ
+}
+
 static int winprop(xcb_window_t win, xcb_atom_t prop, xcb_atom_t *ret)
 {
+	xcb_get_property_cookie_t ck = xcb_get_property(con, 0, win, prop, XCB_ATOM_ANY, 0, 1);
+
+	PERF(PERF_REQUEST);
+	return winpropreply(&ck, ret);
+}
+
+static int winpropreply(xcb_get_property_cookie_t *ck, xcb_atom_t *ret)
+{
+	int ok = 0;
 	xcb_generic_error_t *e;
-	xcb_get_property_cookie_t c;
-	xcb_get_property_reply_t *r = NULL;
+	xcb_get_property_reply_t *r;
 
-	c = xcb_get_property(con, 0, win, prop, XCB_ATOM_ANY, 0, 1);
-	if ((r = xcb_get_property_reply(con, c, &e)) && xcb_get_property_value_length(r)) {
+	PERF(PERF_REPLY);
+	if ((r = xcb_get_property_reply(con, *ck, &e)) && xcb_get_property_value_length(r)) {
 		*ret = *(xcb_atom_t *)xcb_get_property_value(r);
-		free(r);
-		return 1;
+		ok = 1;
 	} else {
 		iferr(0, "unable to get window property reply", e);
 	}
+	ck->sequence = 0;
 	free(r);
-	return 0;
+	return ok;
 }
 
 Client *wintoclient(xcb_window_t win)
 {
-	Client *c;
-	Workspace *ws;
+	void *ptr;
 
-	WINTO(FOR_CLIENTS, win, c, ws);
+	return wintype(win, &ptr) == WIN_CLIENT ? ptr : NULL;
 }
 
 Panel *wintopanel(xcb_window_t win)
 {
-	Panel *p;
+	void *ptr;
 
-	WINTO(FOR_EACH, win, p, panels);
+	return wintype(win, &ptr) == WIN_PANEL ? ptr : NULL;
 }
 
 Desk *wintodesk(xcb_window_t win)
 {
-	Desk *d;
+	void *ptr;
 
-	WINTO(FOR_EACH, win, d, desks);
+	return wintype(win, &ptr) == WIN_DESK ? ptr : NULL;
 }
 
 xcb_window_t wintrans(xcb_window_t win)
 {
+	xcb_get_property_cookie_t ck = xcb_icccm_get_wm_transient_for(con, win);
+
+	PERF(PERF_REQUEST);
+	return wintransreply(&ck);
+}
+
+static xcb_window_t wintransreply(xcb_get_property_cookie_t *ck)
+{
+	int ok;
 	xcb_window_t w;
 	xcb_generic_error_t *e;
 
-	if (!xcb_icccm_get_wm_transient_for_reply(con,
-				xcb_icccm_get_wm_transient_for(con, win), &w, &e))
-	{
+	PERF(PERF_REPLY);
+	ok = xcb_icccm_get_wm_transient_for_reply(con, *ck, &w, &e);
+	ck->sequence = 0;
+	if (!ok) {
 		iferr(0, "unable to get wm transient for hint", e);
 		return XCB_WINDOW_NONE;
 	}
 	return w;
 }
 
-#ifdef FUNCDEBUG
-void __cyg_profile_func_enter(void *fn, void *caller)
+int wintype(xcb_window_t win, void **ptr)
 {
-	int i;
-	Dl_info info;
+	MapEnt *e;
 
-	fprintf(stderr, "dk:");
-	for (i = 0; i < depth; i += 2) fprintf(stderr, " |");
-	if (dladdr(fn, &info))
-		fprintf(stderr, " --> %s (%p)", info.dli_sname ? info.dli_sname : "unknown", fn);
-	else
-		fprintf(stderr, " --> (%p)", fn);
-	if (dladdr(caller, &info))
-		fprintf(stderr, " :: %s (%p)\n", info.dli_sname ? info.dli_sname : "unknown", caller);
-	else
-		fprintf(stderr, " :: (%p)\n", caller);
-	depth += 2;
+	if (win == root || !(e = mapget(&wintab, win))) {
+		if (ptr) *ptr = NULL;
+		return WIN_NONE;
+	}
+	if (ptr) *ptr = e->val;
+	return e->tag;
 }
 
-void __cyg_profile_func_exit(void *fn, void *caller)
+static int wrote(Client *c, int prop, uint32_t val)
 {
-	int i;
-	Dl_info info;
-
-	depth -= 2;
-	fprintf(stderr, "dk:");
-	for (i = depth; i > 0; i -= 2) fprintf(stderr, " |");
-	if (dladdr(fn, &info))
-		fprintf(stderr, " <-- %s (%p)", info.dli_sname ? info.dli_sname : "unknown", fn);
-	else
-		fprintf(stderr, " <-- (%p)", fn);
-	if (dladdr(caller, &info))
-		fprintf(stderr, " :: %s (%p)\n", info.dli_sname ? info.dli_sname : "unknown", caller);
-	else
-		fprintf(stderr, " :: (%p)\n", caller);
+	/* returns 1 when val is what was last written so the write can be
+	 * skipped, otherwise remembers val for next time and returns 0 */
+	if (c->wroteset & (1 << prop) && c->wrote[prop] == val) {
+		wroteskip++;
+		return 1;
+	}
+	c->wroteset |= 1 << prop;
+	c->wrote[prop] = val;
+	return 0;
 }
-#endif
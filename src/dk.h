@@ -11,6 +11,7 @@
 #include <sys/socket.h>
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -47,6 +48,8 @@
 	#endif
 #endif
 
+#define WS_MAX                1024 /* sanity limit on allocated workspaces */
+
 #define LEN(x)                (sizeof(x) / sizeof(*x))
 #define MIN(a, b)             ((a) < (b) ? (a) : (b))
 #define MAX(a, b)             ((a) > (b) ? (a) : (b))
@@ -60,19 +63,12 @@
 #define H(c)            (c->h + (2 * c->bw))
 #define FLOATING(c)     (c->state & STATE_FLOATING || !c->ws->layout->func)
 #define FULLSCREEN(c)   (c->state & STATE_FULLSCREEN && !(c->state & STATE_FAKEFULL))
+#define RETILE(c)       do { if ((c)->ws) (c)->ws->tiledirty = 1; } while (0)
 
 #define FOR_EACH(v, list)    if (list) for (v = list; v; v = v->next)
 #define FOR_CLIENTS(c, ws)   FOR_EACH(ws, workspaces) FOR_EACH(c, ws->clients)
 
 #define FIND_TAIL(v, list)        for (v = list; v && v->next; v = v->next)
-#define FIND_PREV(v, cur, list)   for (v = list; v && v->next && v->next != cur; v = v->next)
-
-#define WINTO(for_macro, win, ptr, arr)                           \
-	do {                                                          \
-		if (win != XCB_WINDOW_NONE && win != root)                \
-			for_macro(ptr, arr) if (ptr->win == win) return ptr;  \
-		return NULL;                                              \
-	} while (0)
 
 #define ATTACH(v, list)           \
 	do {                          \
@@ -87,21 +83,23 @@
 	} while (0)
 
 #define PROP(mode, win, atom, type, membsize, nmemb, value) \
-	xcb_change_property(con, XCB_PROP_MODE_##mode, win, atom, type, (membsize), (nmemb), (const void *)value)
+	PERF(PERF_REQUEST), xcb_change_property(con, XCB_PROP_MODE_##mode, win, atom, type, (membsize), (nmemb), (const void *)value)
 
 #define GET(win, val, error, type, functtype)                                                 \
 	do {                                                                                      \
 		if (win == XCB_WINDOW_NONE) return val;                                               \
+		PERF(PERF_REQUEST);                                                                   \
+		PERF(PERF_REPLY);                                                                     \
 		if (!(val = xcb_get_##functtype##_reply(con, xcb_get_##functtype(con, win), &error))) \
 			iferr(0, "unable to get window " type " reply", error);                           \
 	} while (0)
 
 
 #define MOVE(win, x, y)                                                       \
-	xcb_configure_window(con, win, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, (uint32_t[]){(x), (y)})
+	PERF(PERF_REQUEST), xcb_configure_window(con, win, XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y, (uint32_t[]){(x), (y)})
 
 #define MOVERESIZE(win, x, y, w, h, bw)                                     \
-	xcb_configure_window(con, win,                                          \
+	PERF(PERF_REQUEST), xcb_configure_window(con, win,                      \
 			XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y                       \
 			| XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT            \
 			| XCB_CONFIG_WINDOW_BORDER_WIDTH,                               \
@@ -124,6 +122,7 @@ enum States {
 	STATE_IGNORECFG    = 1 << 10,
 	STATE_ABOVE        = 1 << 11,
 	STATE_HIDDEN       = 1 << 12,
+	STATE_WITHDRAWING  = 1 << 13, /* unmapped by its client, waiting on settle() */
 };
 
 enum Cursors {
@@ -203,11 +202,15 @@ enum Gravities {
 };
 
 enum StatusType {
-	STAT_WS   = 0,
-	STAT_LYT  = 1,
-	STAT_WIN  = 2,
-	STAT_BAR  = 3,
-	STAT_FULL = 4,
+	STAT_WS      = 0,
+	STAT_LYT     = 1,
+	STAT_WIN     = 2,
+	STAT_BAR     = 3,
+	STAT_FULL    = 4,
+	STAT_PERF    = 5,
+	STAT_TRACE   = 6,
+	STAT_LATENCY = 7,
+	STAT_MEM     = 8,
 };
 
 enum CfgType {
@@ -231,6 +234,31 @@ enum GlobalSettings {
 	GLB_LAST         = 11,
 };
 
+enum Pools {
+	POOL_CLIENT = 0,
+	POOL_PANEL  = 1,
+	POOL_DESK   = 2,
+	POOL_RULE   = 3,
+	POOL_STATUS = 4,
+	POOL_LAST   = 5,
+};
+
+enum Wrote {
+	WROTE_WMSTATE  = 0,
+	WROTE_NETSTATE = 1,
+	WROTE_DESK     = 2,
+	WROTE_LAST     = 3,
+};
+
+enum WinType {
+	WIN_NONE     = 0, /* not in the registry */
+	WIN_CLIENT   = 1,
+	WIN_PANEL    = 2,
+	WIN_DESK     = 3,
+	WIN_IGNORE   = 4, /* seen and deliberately left unmanaged */
+	WIN_OVERRIDE = 5, /* override_redirect when last seen */
+};
+
 
 typedef struct Callback Callback;
 typedef struct Workspace Workspace;
@@ -262,6 +290,8 @@ typedef struct Rule {
 	char *title, *class, *inst, *mon;
 	const Callback *cb;
 	regex_t titlereg, classreg, instreg;
+	const char *classseen, *instseen; /* last interned string matched and its result */
+	int classhit, insthit;
 	struct Rule *next;
 } Rule;
 
@@ -269,7 +299,7 @@ typedef struct Panel {
 	int x, y, w, h;
 	int l, r, t, b; /* struts */
 	uint32_t state;
-	char class[64], inst[64];
+	const char *class, *inst; /* interned */
 	xcb_window_t win;
 	struct Panel *next;
 	Monitor *mon;
@@ -284,17 +314,59 @@ typedef struct Status {
 } Status;
 
 typedef struct Client {
-	char title[256], class[64], inst[64];
-	int32_t x, y, w, h, bw, hoff, depth, old_x, old_y, old_w, old_h, old_bw;
-	int32_t max_w, max_h, min_w, min_h, base_w, base_h, inc_w, inc_h, hints;
-	float min_aspect, max_aspect;
-	uint32_t state, old_state;
+	/* hot: read by layouts, refresh() and the event handlers, keep these
+	 * first and together so walking a workspace stays within two cache
+	 * lines per client rather than skipping over the strings below */
+	int32_t x, y, w, h, bw, hoff;
+	uint32_t state;
 	xcb_window_t win;
-	struct Client *trans, *next, *snext;
+	struct Client *next, *prev, *snext, *sprev, *trans;
 	Workspace *ws;
+	int tidx; /* index in ws->tiled, -1 when floating */
+	int32_t max_w, max_h, min_w, min_h, base_w, base_h, inc_w, inc_h, hints;
+	float min_aspect, max_aspect;
+
+	/* cold: transients, saved state, status output and rule matching */
+	struct Client *tchild, *tnext; /* transients of this client, siblings sharing trans */
+	int32_t depth, old_x, old_y, old_w, old_h, old_bw;
+	uint32_t old_state;
 	const Callback *cb;
+	const char *class, *inst; /* interned */
+	char *title;
+	size_t titlesz;
+
+	/* properties kept until a PropertyNotify for them, see propertynotify() */
+	xcb_atom_t type;
+	uint32_t protos; /* WM_PROTOCOLS, bits are (1 << enum WMAtoms) */
+	int haswmh;
+	xcb_icccm_wm_hints_t wmh;
+
+	/* last value dk wrote for each enum Wrote property, valid when its bit is set */
+	uint32_t wrote[WROTE_LAST], wroteset;
 } Client;
 
+/* client pool slots are 64 byte aligned, see pools[] in dk.c */
+_Static_assert(offsetof(Client, tchild) <= 128, "Client hot fields no longer fit in two cache lines");
+
+typedef struct WinFetch {
+	/* requests for a newly mapped window, sent together by winfetch() and
+	 * winfetchprops() and collected by the *reply() functions, a sequence
+	 * of 0 means consumed or never sent */
+	xcb_get_window_attributes_cookie_t attr;
+	xcb_get_geometry_cookie_t geom;
+	xcb_get_property_cookie_t type, state, desk, wmstate, class, trans;
+	xcb_get_property_cookie_t motif, netname, wmname, normal, hints, proto;
+	xcb_get_window_attributes_reply_t *wa; /* attributes read ahead by initscan() */
+	xcb_window_t transfor; /* WM_TRANSIENT_FOR when read ahead of the rest */
+	int props; /* winfetchprops() was sent, only for windows being managed */
+} WinFetch;
+
+typedef struct Check {
+	xcb_void_cookie_t ck;
+	int lvl;
+	char *msg;
+} Check;
+
 typedef struct Cmd {
 	const char *str;
 	int (*func)(char **);
@@ -331,8 +403,11 @@ struct Workspace {
 	int num;
 	char name[64];
 	Monitor *mon;
-	Workspace *next;
+	Workspace *next, *prev;
 	Client *sel, *stack, *clients;
+	Client *stail, *ctail;
+	Client **tiled; /* NULL terminated, rebuilt by tiled() after RETILE() */
+	int ntiled, tiledsz, tiledirty;
 };
 
 
@@ -341,7 +416,7 @@ extern FILE *cmdresp;
 extern uint32_t lockmask;
 extern char *argv0, **environ;
 extern int scr_h, scr_w, randrbase, cmdusemon, winchange, wschange, lytchange;
-extern int running, restart, needsrefresh, status_usingcmdresp, depth;
+extern int running, restart, needsrefresh, status_usingcmdresp;
 
 extern Desk *desks;
 extern Rule *rules;
@@ -368,6 +443,7 @@ extern const char *gravities[GRAV_LAST];
 
 /* config.h values */
 extern uint32_t border[BORD_LAST];
+extern unsigned int prealloc[POOL_LAST];
 extern GlobalCfg globalcfg[GLB_LAST];
 extern xcb_mod_mask_t mousemod;
 extern xcb_button_t mousemove, mouseresize;
@@ -381,10 +457,12 @@ extern Workspace wsdef;
 
 int applysizehints(Client *c, int *x, int *y, int *w, int *h, int bw, int usermotion, int mouse);
 int assignws(Workspace *ws, Monitor *new); //NOLINT
+void attachafter(Client *c, Client *after);
 void changews(Workspace *ws, int swap, int warp);
 void clientborder(Client *c, int focused);
 void clienthints(Client *c);
 int clientname(Client *c);
+void clientprotos(Client *c);
 void clientrule(Client *c, Rule *wr, int nofocus);
 void clienttype(Client *c);
 Monitor *coordtomon(int x, int y);
@@ -416,27 +494,27 @@ void sendconfigure(Client *c);
 int sendwmproto(Client *c, int wmproto);
 void setfullscreen(Client *c, int fullscreen);
 void setinputfocus(Client *c);
+void setnetdesk(Client *c, uint32_t desk);
 void setnetstate(xcb_window_t win, uint32_t state);
 void setnetwsnames(void);
 void setstackmode(xcb_window_t win, uint32_t mode);
+void settrans(Client *c, Client *trans);
 void seturgent(Client *c, int urg);
 void setwinstate(xcb_window_t win, uint32_t state);
 void setworkspace(Client *c, int num, int stacktail);
 void showhide(Client *c);
 void sizehints(Client *c, int uss);
 int tilecount(Workspace *ws);
+Client **tiled(Workspace *ws);
 void unfocus(Client *c, int focusroot);
 void unmanage(xcb_window_t win, int destroyed);
 int updrandr(int init);
+void updlockmask(void);
 void updstruts(void);
 void updworkspaces(int needed);
 Client *wintoclient(xcb_window_t win);
 Desk *wintodesk(xcb_window_t win);
 Panel *wintopanel(xcb_window_t win);
 xcb_window_t wintrans(xcb_window_t win);
-
-#ifdef FUNCDEBUG
-void __cyg_profile_func_enter(void *fn, void *caller) __attribute__((no_instrument_function));
-void __cyg_profile_func_exit(void *fn, void *caller) __attribute__((no_instrument_function));
-#endif
+int wintype(xcb_window_t win, void **ptr);
 
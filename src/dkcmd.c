@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <err.h>
 
 #include "strl.h"
@@ -21,25 +22,70 @@
 #define VERSION "1.0"
 #endif
 
-int main(int argc, char *argv[])
+#define TRAILER_MAX 32 /* "\ntime=" and the microseconds */
+
+enum Timing { T_CONNECT, T_SERVER, T_TOTAL, T_LAST };
+
+static const char *timenames[T_LAST] = { "connect", "server", "total" };
+
+static int cmpdouble(const void *a, const void *b)
 {
-	size_t j = 0, n = 0;
-	int i, fd, ret = 0, offs = 1;
-	char *sock, *equal = NULL, *space = NULL, buf[BUFSIZ], resp[BUFSIZ];
-	char *help = "[-hv] <COMMAND>";
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double mssince(struct timespec *t0)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (t.tv_sec - t0->tv_sec) * 1000.0 + (t.tv_nsec - t0->tv_nsec) / 1000000.0;
+}
+
+static void printresp(char *prog, char *resp, int *ret)
+{
+	if ((*ret = *resp == '!')) {
+		fprintf(stderr, "%s: error: %s\n", prog, resp + 1);
+		fflush(stderr);
+	} else {
+		fprintf(stdout, "%s\n", resp);
+		fflush(stdout);
+	}
+}
+
+static void emit(char *prog, char *s, size_t len, int quiet, int *started, int *ret)
+{
+	if (!len) return;
+	if (!*started) {
+		*started = 1;
+		if ((*ret = *s == '!')) {
+			fprintf(stderr, "%s: error: ", prog);
+			s++, len--;
+		}
+	}
+	if (*ret)
+		fwrite(s, 1, len, stderr);
+	else if (!quiet)
+		fwrite(s, 1, len, stdout);
+}
+
+static int run(char *prog, char *buf, size_t n, int timed, int quiet, double *t)
+{
+	ssize_t s;
+	int fd, ret = 0, started = 0;
+	size_t len = 0;
+	char *sock, *nl, chunk[BUFSIZ], held[BUFSIZ + TRAILER_MAX];
+	struct timespec t0;
 	struct sockaddr_un addr;
 	struct pollfd fds[] = {
 		{ -1,            POLLIN,  0 },
 		{ STDOUT_FILENO, POLLHUP, 0 },
 	};
 
-	if (argc == 1)
-		return usage(argv[0], VERSION, 1, 'h', help);
-	else if (!strcmp(argv[1], "-v") || !strcmp(argv[1], "-h"))
-		return usage(argv[0], VERSION, 0, argv[1][1], help);
-
 	if (!(sock = getenv("DKSOCK")))
 		err(1, "unable to get socket path from environment");
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 	addr.sun_family = AF_UNIX;
 	check((fd = socket(AF_UNIX, SOCK_STREAM, 0)), "unable to create socket");
 	fds[0].fd = fd;
@@ -47,8 +93,78 @@ int main(int argc, char *argv[])
 	if (addr.sun_path[0] == '\0')
 		err(1, "unable to write socket path: %s", sock);
 	check(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), "unable to connect socket");
+	t[T_CONNECT] = mssince(&t0);
+
+	check(send(fd, buf, n, 0), "unable to send command");
+
+	/* the response is passed through as it arrives so repeating status
+	 * output keeps working, with timing only the text after the last
+	 * newline is held back in case it's the time the server appends */
+	while (poll(fds, 2, -1) > 0) {
+		if (fds[1].revents & (POLLERR | POLLHUP)) break;
+		if (fds[0].revents & POLLIN) {
+			if ((s = recv(fd, chunk, sizeof(chunk) - 1, 0)) <= 0) break;
+			chunk[s] = '\0';
+			if (!timed) {
+				printresp(prog, chunk, &ret);
+				continue;
+			}
+			memcpy(held + len, chunk, s);
+			held[(len += s)] = '\0';
+			if ((nl = strrchr(held, '\n')) && held + len - nl <= TRAILER_MAX) {
+				emit(prog, held, nl - held, quiet, &started, &ret);
+				memmove(held, nl, (len -= nl - held) + 1);
+			} else {
+				emit(prog, held, len, quiet, &started, &ret);
+				len = 0;
+			}
+		}
+	}
+	close(fd);
+	t[T_TOTAL] = mssince(&t0);
+
+	if (timed) {
+		t[T_SERVER] = -1;
+		if (len && !strncmp(held, "\ntime=", 6))
+			t[T_SERVER] = strtoul(held + 6, NULL, 10) / 1000.0;
+		else
+			emit(prog, held, len, quiet, &started, &ret);
+		if (started && (ret || !quiet))
+			fputc('\n', ret ? stderr : stdout);
+		fflush(stdout);
+		fflush(stderr);
+	}
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	size_t j = 0, n = 0;
+	int i, ret = 0, offs = 1, timed = 0, repeat = 1, first = 1;
+	char *end, *equal = NULL, *space = NULL, buf[BUFSIZ];
+	char *help = "[-hvt] [-r NUM] <COMMAND>";
+	double t[T_LAST], *runs[T_LAST];
 
-	for (i = 1, j = 0, offs = 1; n + 1 < sizeof(buf) && i < argc; i++, j = 0, offs = 1) {
+	for (; first < argc && argv[first][0] == '-'; first++) {
+		if (!strcmp(argv[first], "-v") || !strcmp(argv[first], "-h")) {
+			return usage(argv[0], VERSION, 0, argv[first][1], help);
+		} else if (!strcmp(argv[first], "-t")) {
+			timed = 1;
+		} else if (!strcmp(argv[first], "-r")) {
+			if (first + 1 >= argc || (repeat = strtol(argv[++first], &end, 0)) <= 0 || *end != '\0')
+				errx(1, "-r requires a number of runs greater than 0");
+			timed = 1;
+		} else {
+			return usage(argv[0], VERSION, 1, 'h', help);
+		}
+	}
+	if (first >= argc)
+		return usage(argv[0], VERSION, 1, 'h', help);
+
+	/* a leading time keyword asks the server to append its processing time */
+	if (timed)
+		n = strlcpy(buf, "time ", sizeof(buf));
+	for (i = first, j = 0, offs = 1; n + 1 < sizeof(buf) && i < argc; i++, j = 0, offs = 1) {
 		if ((space = strchr(argv[i], ' ')) || (space = strchr(argv[i], '\t'))) {
 			if (!(equal = strchr(argv[i], '=')) || space < equal)
 				buf[n++] = '"';
@@ -67,26 +183,35 @@ int main(int argc, char *argv[])
 	}
 	buf[n - 1] = '\0';
 
-	check(send(fd, buf, n, 0), "unable to send command");
+	if (repeat == 1) {
+		ret = run(argv[0], buf, n, timed, 0, t);
+		if (timed) {
+			for (j = 0; j < T_LAST; j++)
+				if (t[j] >= 0) fprintf(stderr, "%s%s %.3fms", j ? " " : "", timenames[j], t[j]);
+			fprintf(stderr, "\n");
+		}
+		return ret;
+	}
 
-	ssize_t s;
-	while (poll(fds, 2, -1) > 0) {
-		if (fds[1].revents & (POLLERR | POLLHUP)) break;
-		if (fds[0].revents & POLLIN) {
-			if ((s = recv(fd, resp, sizeof(resp) - 1, 0)) > 0) {
-				resp[s] = '\0';
-				if ((ret = *resp == '!')) {
-					fprintf(stderr, "%s: error: %s\n", argv[0], resp + 1);
-					fflush(stderr);
-				} else {
-					fprintf(stdout, "%s\n", resp);
-					fflush(stdout);
-				}
-			} else {
-				break;
-			}
+	for (j = 0; j < T_LAST; j++)
+		runs[j] = ecalloc(repeat, sizeof(double));
+	for (i = 0; i < repeat && !ret; i++) {
+		ret = run(argv[0], buf, n, 1, 1, t);
+		for (j = 0; j < T_LAST; j++)
+			runs[j][i] = t[j];
+	}
+	if (!ret) {
+		fprintf(stdout, "# runs=%d min p50 p90 p99 max (ms)", repeat);
+		for (j = 0; j < T_LAST; j++) {
+			qsort(runs[j], repeat, sizeof(double), cmpdouble);
+			if (runs[j][0] < 0) continue; /* no time from the server */
+			fprintf(stdout, "\n%s %.3f %.3f %.3f %.3f %.3f", timenames[j], runs[j][0],
+					runs[j][(int)(0.50 * (repeat - 1))], runs[j][(int)(0.90 * (repeat - 1))],
+					runs[j][(int)(0.99 * (repeat - 1))], runs[j][repeat - 1]);
 		}
+		fprintf(stdout, "\n");
 	}
-	close(fd);
+	for (j = 0; j < T_LAST; j++)
+		free(runs[j]);
 	return ret;
 }
@@ -19,6 +19,8 @@
 #include "parse.h"
 #include "layout.h"
 #include "event.h"
+#include "perf.h"
+#include "util.h"
 
 
 static void (*handlers[XCB_NO_OPERATION + 1])(xcb_generic_event_t *) = {
@@ -37,6 +39,23 @@ static void (*handlers[XCB_NO_OPERATION + 1])(xcb_generic_event_t *) = {
 	[XCB_NO_OPERATION]      = NULL
 };
 
+/* event types dropped until the end of the current batch when caused by a
+ * request sent before the sequence recorded for them, see ignore() */
+static uint64_t ignored;
+static uint32_t ignoreseq[64];
+
+/* checked requests, errors are collected in settle() instead of waiting */
+static Check *checks;
+static unsigned int nchecks, checkssz;
+
+/* windows unmapped by their client, unmanaged in settle() once it's known
+ * whether a DestroyNotify followed, dk's own unmaps are masked out in
+ * clientunmap() so they never get here */
+static xcb_window_t *withdrawn;
+static unsigned int nwithdrawn, withdrawnsz;
+
+static int withdrawcancel(xcb_window_t win);
+
 void buttonpress(xcb_generic_event_t *ev)
 {
 	Client *c, *v;
@@ -48,12 +67,17 @@ void buttonpress(xcb_generic_event_t *ev)
 	if (c != selws->sel) focus(c);
 	if (FLOATING(c) && (e->detail == mousemove || e->detail == mouseresize)) {
 		setstackmode(c->win, XCB_STACK_MODE_ABOVE);
+		for (v = c->tchild; v; v = v->tnext)
+			if (v->ws == c->ws && FLOATING(v))
+				setstackmode(v->win, XCB_STACK_MODE_ABOVE);
 		if (!(c->state & STATE_ABOVE))
 			for (v = c->ws->stack; v; v = v->snext)
 				if (v->state & STATE_ABOVE && ((v->state & STATE_FLOATING) || v->ws->layout->func == NULL))
 					setstackmode(v->win, XCB_STACK_MODE_ABOVE);
 		xcb_flush(con);
+		latend();
 	}
+	PERF(PERF_REQUEST);
 	xcb_allow_events(con, XCB_ALLOW_REPLAY_POINTER, e->time);
 	if ((e->state & ~(lockmask | XCB_MOD_MASK_LOCK)) == (mousemod & ~(lockmask | XCB_MOD_MASK_LOCK))
 			&& (e->detail == mousemove || e->detail == mouseresize))
@@ -66,6 +90,7 @@ void buttonpress(xcb_generic_event_t *ev)
 				| XCB_EVENT_MASK_BUTTON_MOTION | XCB_EVENT_MASK_POINTER_MOTION,
 				XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC, root,
 				cursor[e->detail == mousemove ? CURS_MOVE : CURS_RESIZE], XCB_CURRENT_TIME);
+		PERF(PERF_REQUEST), PERF(PERF_REPLY);
 		if ((p = xcb_grab_pointer_reply(con, pc, &er)) && p->status == XCB_GRAB_STATUS_SUCCESS)
 			mousemotion(c, e->detail, e->root_x, e->root_y);
 		else
@@ -77,12 +102,17 @@ void buttonpress(xcb_generic_event_t *ev)
 void buttonrelease(int move)
 {
 	DBG("buttonrelease: ungrabbing pointer - 0x%08x", selws->sel->win)
-	iferr(1, "failed to ungrab pointer",
-			xcb_request_check(con, xcb_ungrab_pointer_checked(con, XCB_CURRENT_TIME)));
-	if (!move) {
+	PERF(PERF_REQUEST);
+	checklater(xcb_ungrab_pointer_checked(con, XCB_CURRENT_TIME), 1, "failed to ungrab pointer");
+	if (!move)
 		ignore(XCB_ENTER_NOTIFY);
-		xcb_aux_sync(con);
-	}
+}
+
+void checklater(xcb_void_cookie_t ck, int lvl, char *msg)
+{
+	if (nchecks == checkssz)
+		checks = erealloc(checks, (checkssz = checkssz ? checkssz * 2 : 16) * sizeof(Check));
+	checks[nchecks++] = (Check){ ck, lvl, msg };
 }
 
 void clientmessage(xcb_generic_event_t *ev)
@@ -115,13 +145,13 @@ void clientmessage(xcb_generic_event_t *ev)
 				DBG("clientmessage: state fullscreen: %d", (d[0] == 1 || (d[0] == 2 && !(c->state & STATE_FULLSCREEN))))
 				setfullscreen(c, (d[0] == 1 || (d[0] == 2 && !(c->state & STATE_FULLSCREEN))));
 				ignore(XCB_ENTER_NOTIFY);
-				xcb_aux_sync(con);
 			} else if (d[1] == netatom[NET_STATE_ABOVE] || d[2] == netatom[NET_STATE_ABOVE]) {
 				int above = d[0] == 1 || (d[0] == 2 && !(c->state & STATE_FULLSCREEN));
 				DBG("clientmessage: state above: %d", above)
-				if (above && !(c->state & STATE_ABOVE))
+				if (above && !(c->state & STATE_ABOVE)) {
 					c->state |= STATE_ABOVE | STATE_FLOATING;
-				else if (!above && (c->state & STATE_ABOVE))
+					RETILE(c);
+				} else if (!above && (c->state & STATE_ABOVE))
 					c->state &= ~STATE_ABOVE;
 				needsrefresh = 1;
 			} else if ((d[1] == netatom[NET_STATE_DEMANDATT]
@@ -217,7 +247,7 @@ void configrequest(xcb_generic_event_t *ev)
 			}
 			if (c->ws == m->ws) {
 				DBG("configrequest: visible window, performing resize: %d,%d %dx%d", c->x, c->y, c->w, c->h)
-				sizehints(c, 0);
+				if (!c->hints) sizehints(c, 0);
 				applysizehints(c, &c->x, &c->y, &c->w, &c->h, c->bw, 0, 0);
 				MOVERESIZE(c->win, c->x, c->y, c->w, c->h, c->bw);
 				sendconfigure(c);
@@ -236,6 +266,7 @@ void configrequest(xcb_generic_event_t *ev)
 			.stack_mode = e->stack_mode,
 			.border_width = e->border_width
 		};
+		PERF(PERF_REQUEST);
 		xcb_aux_configure_window(con, e->window, e->value_mask, &wc);
 	}
 	xcb_flush(con);
@@ -243,15 +274,36 @@ void configrequest(xcb_generic_event_t *ev)
 
 void destroynotify(xcb_generic_event_t *ev)
 {
-	unmanage(((xcb_destroy_notify_event_t *)ev)->window, 1);
+	xcb_window_t win = ((xcb_destroy_notify_event_t *)ev)->window;
+
+	withdrawcancel(win);
+	unmanage(win, 1);
 }
 
 void dispatch(xcb_generic_event_t *ev)
 {
 	short type;
-
-	if ((type = ev->response_type & 0x7f)) {
-		if (handlers[type]) {
+	PerfOp *prev;
+	const char *name;
+
+	if (!(type = ev->response_type & 0x7f))
+		name = "Error";
+	else if (ev->response_type == randrbase + XCB_RANDR_SCREEN_CHANGE_NOTIFY)
+		name = "RandrScreenChangeNotify";
+	else if (!(name = xcb_event_get_label(type)))
+		name = "Unknown";
+	prev = perfenter(PERF_OP_EVENT(type), name);
+	latbegin();
+	trace(TR_DISPATCH, 0, ev->response_type);
+
+	if (type) {
+		if (type < 64 && ignored & (1ULL << type)
+				&& (int32_t)(ev->full_sequence - ignoreseq[type]) < 0)
+		{
+			DBG("dispatch: ignoring %s", type == XCB_ENTER_NOTIFY
+					? "XCB_ENTER_NOTIFY" : type == XCB_CONFIGURE_REQUEST
+					? "XCB_CONFIGURE_REQUEST" : "UNKNOWN")
+		} else if (handlers[type]) {
 			handlers[type](ev);
 		} else if (ev->response_type == randrbase + XCB_RANDR_SCREEN_CHANGE_NOTIFY
 				&& ((xcb_randr_screen_change_notify_event_t *)ev)->root == root)
@@ -274,13 +326,15 @@ void dispatch(xcb_generic_event_t *ev)
 				|| (e->error_code == XCB_G_CONTEXT
 					&& (e->major_code == XCB_CHANGE_GC || e->major_code == XCB_FREE_GC))
 				|| (e->error_code == XCB_PIXMAP && e->major_code == XCB_FREE_PIXMAP))
-			return;
+			goto end;
 		fprintf(stderr, "dk: previous request returned error %i, \"%s\""
 				" major code %u, minor code %u resource id %u sequence %u\n",
 				e->error_code, xcb_event_get_error_label(e->error_code),
 				(uint32_t)e->major_code, (uint32_t) e->minor_code,
 				(uint32_t)e->resource_id, (uint32_t) e->sequence);
 	}
+end:
+	perfleave(prev);
 }
 
 void enternotify(xcb_generic_event_t *ev)
@@ -323,37 +377,42 @@ void focusin(xcb_generic_event_t *ev)
 
 void ignore(uint8_t type)
 {
-	xcb_generic_event_t *ev = NULL;
-
+	/* events of this type caused by the requests sent so far are dropped,
+	 * events carry the last request the server had processed so anything
+	 * before the no-op is ours and anything after it came from a client,
+	 * settle() does the round trip once for the whole batch */
+	ignored |= 1ULL << type;
+	PERF(PERF_REQUEST);
+	ignoreseq[type] = xcb_no_operation(con).sequence;
 	xcb_flush(con);
-	while (running && (ev = xcb_poll_for_event(con))) {
-		if ((ev->response_type & 0x7f) != type) {
-			dispatch(ev);
-		} else {
-			DBG("ignore: %s", type == XCB_ENTER_NOTIFY
-					? "XCB_ENTER_NOTIFY" : type == XCB_CONFIGURE_REQUEST
-					? "XCB_CONFIGURE_REQUEST" : "UNKNOWN")
-		}
-		free(ev);
-	}
 }
 
 void mappingnotify(xcb_generic_event_t *ev)
 {
 	Client *c;
 	Workspace *ws;
+	uint32_t old = lockmask;
 	xcb_mapping_notify_event_t *e = (xcb_mapping_notify_event_t *)ev;
 
+	/* a keyboard mapping can move the numlock keysym to another keycode
+	 * so both kinds refresh the lockmask, the grabs only depend on that */
 	if (e->request == XCB_MAPPING_KEYBOARD || e->request == XCB_MAPPING_MODIFIER) {
 		xcb_refresh_keyboard_mapping(keysyms, e);
-		FOR_CLIENTS(c, ws)
-			grabbuttons(c);
+		updlockmask();
+		if (lockmask != old)
+			FOR_CLIENTS(c, ws)
+				grabbuttons(c);
 	}
 }
 
 void maprequest(xcb_generic_event_t *ev)
 {
-	manage(((xcb_map_request_event_t *)ev)->window, 0);
+	xcb_window_t win = ((xcb_map_request_event_t *)ev)->window;
+
+	/* remapped before settle() got to it, finish the withdraw first so
+	 * the window is managed fresh */
+	if (withdrawcancel(win)) unmanage(win, 0);
+	manage(win, 0);
 }
 
 void motionnotify(xcb_generic_event_t *ev)
@@ -396,6 +455,7 @@ void mousemotion(Client *c, xcb_button_t button, int mx, int my)
 					int x = c->x, y = c->y, w = c->w, h = c->h;
 					c->state |= STATE_FLOATING;
 					c->old_state |= STATE_FLOATING;
+					RETILE(c);
 					if (c->max_w) w = MIN(c->w, c->max_w);
 					if (c->max_h) h = MIN(c->h, c->max_h);
 					if (w == c->ws->mon->ww) w = c->ws->mon->w * 0.75;
@@ -418,25 +478,29 @@ void mousemotion(Client *c, xcb_button_t button, int mx, int my)
 				}
 				resizehint(c, nx, ny, c->w, c->h, c->bw, 1, 1);
 				xcb_flush(con);
+				latend();
 				break;
 			case XCB_BUTTON_RELEASE:
 				released = 1;
 				buttonrelease(1);
 				break;
 			default: /* handle other event types normally */
+				latstamp();
 				dispatch(ev);
 				break;
 			}
 			free(ev);
 		}
 	} else {
-		Client *p, *prev = NULL;
+		Client *prev = NULL;
 		int (*lyt)(Workspace *) = selws->layout->func;
 		int i, nw, nh, first = 1, left = lyt == ltile, ow = c->w, oh = c->h;
 
-		for (i = 0, p = nexttiled(selws->clients); p && p != c; p = nexttiled(p->next), i++)
-			if (nexttiled(p->next) == c)
-				prev = (i + 1 == selws->nmaster || i + 1 == selws->nstack + selws->nmaster) ? NULL : p;
+		Client **t = tiled(selws);
+		if ((i = c->tidx) < 0 || !lyt)
+			i = tilecount(selws);
+		else if (i && i != selws->nmaster && i != selws->nstack + selws->nmaster)
+			prev = t[i - 1];
 		while (running && !released && (ev = xcb_wait_for_event(con))) {
 			switch (ev->response_type & 0x7f) {
 			case XCB_MOTION_NOTIFY:
@@ -471,13 +535,13 @@ void mousemotion(Client *c, xcb_button_t button, int mx, int my)
 					}
 
 					if (prev || ((i == selws->nmaster || i == selws->nmaster + selws->nstack)
-								&& nexttiled(c->next)))
+								&& i + 1 < selws->ntiled))
 					{
 						int ohoff = c->hoff;
 						if (first) {
 							first = 0;
 							if (i + 1 == selws->nmaster || i + 1 == selws->nmaster + selws->nstack
-									|| !nexttiled(c->next))
+									|| i + 1 >= selws->ntiled)
 							{
 								c->hoff = ((e->root_y - my) * -1) + ohoff;
 								my += ohoff;
@@ -487,7 +551,7 @@ void mousemotion(Client *c, xcb_button_t button, int mx, int my)
 							}
 						} else {
 							if (i + 1 == selws->nmaster || i + 1 == selws->nmaster + selws->nstack
-									|| !nexttiled(c->next))
+									|| i + 1 >= selws->ntiled)
 								c->hoff = ((e->root_y - my) * -1);
 							else
 								c->hoff = (e->root_y - my);
@@ -506,11 +570,13 @@ void mousemotion(Client *c, xcb_button_t button, int mx, int my)
 					{
 						c->state |= STATE_FLOATING;
 						c->old_state |= STATE_FLOATING;
+						RETILE(c);
 						if (selws->layout->func) selws->layout->func(selws);
 						restack(selws);
 					}
 					resizehint(c, c->x, c->y, nw, nh, c->bw, 1, 1);
 					xcb_flush(con);
+					latend();
 				}
 				break;
 			case XCB_BUTTON_RELEASE:
@@ -518,6 +584,7 @@ void mousemotion(Client *c, xcb_button_t button, int mx, int my)
 				buttonrelease(0);
 				break;
 			default: /* handle other event types normally */
+				latstamp();
 				dispatch(ev);
 				break;
 			}
@@ -528,18 +595,31 @@ void mousemotion(Client *c, xcb_button_t button, int mx, int my)
 
 void propertynotify(xcb_generic_event_t *ev)
 {
+	void *ptr;
 	Panel *p;
 	Client *c;
 	xcb_property_notify_event_t *e = (xcb_property_notify_event_t *)ev;
 
-	if (e->state == XCB_PROPERTY_DELETE || e->window == root) return;
-	if ((c = wintoclient(e->window))) {
+	if (e->window == root) return;
+	switch (wintype(e->window, &ptr)) {
+	case WIN_CLIENT:
+		c = ptr;
+		/* someone else changed a property we skip rewriting, see wrote() */
+		if (e->atom == wmatom[WM_STATE])
+			c->wroteset &= ~(1 << WROTE_WMSTATE);
+		else if (e->atom == netatom[NET_WM_STATE])
+			c->wroteset &= ~(1 << WROTE_NETSTATE);
+		else if (e->atom == netatom[NET_WM_DESK])
+			c->wroteset &= ~(1 << WROTE_DESK);
+		if (e->state == XCB_PROPERTY_DELETE) break;
 		switch (e->atom) {
 		case XCB_ATOM_WM_HINTS: clienthints(c); break;
 		case XCB_ATOM_WM_NORMAL_HINTS: c->hints = 0; break;
 		case XCB_ATOM_WM_TRANSIENT_FOR:
-			if ((c->trans = wintoclient(wintrans(c->win))) && !FLOATING(c)) {
+			settrans(c, wintoclient(wintrans(c->win)));
+			if (c->trans && !FLOATING(c)) {
 				c->state |= STATE_FLOATING;
+				RETILE(c);
 				needsrefresh = 1;
 			}
 			break;
@@ -548,29 +628,89 @@ void propertynotify(xcb_generic_event_t *ev)
 				if (clientname(c)) winchange = 1;
 			} else if (e->atom == netatom[NET_WM_TYPE]) {
 				clienttype(c);
+			} else if (e->atom == wmatom[WM_PROTO]) {
+				clientprotos(c);
 			}
 			break;
 		}
-	} else if ((e->atom == netatom[NET_WM_STRUTP] || e->atom == netatom[NET_WM_STRUT])
-			&& (p = wintopanel(e->window)))
-	{
-		fillstruts(p);
-		updstruts();
-		needsrefresh = 1;
+		break;
+	case WIN_PANEL:
+		p = ptr;
+		if (e->state == XCB_PROPERTY_DELETE) break;
+		if (e->atom == netatom[NET_WM_STRUTP] || e->atom == netatom[NET_WM_STRUT]) {
+			fillstruts(p);
+			updstruts();
+			needsrefresh = 1;
+		}
+		break;
+	}
+}
+
+int settle(void)
+{
+	/* called once the pending events have been handled, a single sync
+	 * makes sure every event and error caused so far has arrived so the
+	 * ignored types can be dropped and the checked requests won't block,
+	 * returns 1 when anything was done so the caller can refresh again */
+	xcb_generic_event_t *ev;
+	xcb_get_input_focus_cookie_t sync;
+
+	if (!ignored && !nchecks && !nwithdrawn) return 0;
+	PERF(PERF_SYNC);
+	sync = xcb_get_input_focus(con); /* what xcb_aux_sync() does, but we need the sequence */
+	free(xcb_get_input_focus_reply(con, sync, NULL));
+	for (unsigned int i = 0; i < nchecks; i++)
+		iferr(checks[i].lvl, checks[i].msg, xcb_request_check(con, checks[i].ck));
+	nchecks = 0;
+	while (running && (ev = xcb_poll_for_event(con))) {
+		latstamp();
+		dispatch(ev);
+		free(ev);
 	}
+
+	/* types ignored by the handlers above weren't covered by this sync and
+	 * stay set, the caller calls us again until they are */
+	for (unsigned int t = 0; t < 64; t++)
+		if (ignored & (1ULL << t) && (int32_t)(ignoreseq[t] - sync.sequence) < 0)
+			ignored &= ~(1ULL << t);
+
+	/* still here after the sync so they weren't destroyed, just withdrawn */
+	while (nwithdrawn) {
+		DBG("settle: un-managing window: 0x%08x", withdrawn[nwithdrawn - 1])
+		unmanage(withdrawn[--nwithdrawn], 0);
+		ignore(XCB_ENTER_NOTIFY);
+	}
+	return 1;
 }
 
 void unmapnotify(xcb_generic_event_t *ev)
 {
-	xcb_generic_error_t *er;
+	Client *c;
 	xcb_unmap_notify_event_t *e = (xcb_unmap_notify_event_t *)ev;
 
-	if (e->event == root) return;
-	free(xcb_query_tree_reply(con, xcb_query_tree(con, e->window), &er));
-	if (er) { free(er); return; }
+	if (e->event == root || wintype(e->window, NULL) == WIN_NONE) return;
+	for (unsigned int i = 0; i < nwithdrawn; i++)
+		if (withdrawn[i] == e->window) return;
+	DBG("unmapnotify: withdrawing window: 0x%08x", e->window)
+	if ((c = wintoclient(e->window))) {
+		/* keep it out of the layout and focus until settle() unmanages it */
+		c->state |= STATE_WITHDRAWING;
+		c->state &= ~STATE_NEEDSMAP;
+		RETILE(c);
+		needsrefresh = 1;
+		if (c == selws->sel) focus(NULL);
+	}
+	if (nwithdrawn == withdrawnsz)
+		withdrawn = erealloc(withdrawn, (withdrawnsz = withdrawnsz ? withdrawnsz * 2 : 16) * sizeof(xcb_window_t));
+	withdrawn[nwithdrawn++] = e->window;
+}
 
-	DBG("unmapnotify: un-managing window: 0x%08x", e->window)
-	unmanage(e->window, 0);
-	ignore(XCB_ENTER_NOTIFY);
-	xcb_aux_sync(con);
+static int withdrawcancel(xcb_window_t win)
+{
+	for (unsigned int i = 0; i < nwithdrawn; i++)
+		if (withdrawn[i] == win) {
+			withdrawn[i] = withdrawn[--nwithdrawn];
+			return 1;
+		}
+	return 0;
 }
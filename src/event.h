@@ -9,6 +9,7 @@
 
 void buttonpress(xcb_generic_event_t *ev);
 void buttonrelease(int move);
+void checklater(xcb_void_cookie_t ck, int lvl, char *msg);
 void clientmessage(xcb_generic_event_t *ev);
 void confignotify(xcb_generic_event_t *ev);
 void configrequest(xcb_generic_event_t *ev);
@@ -22,4 +23,5 @@ void maprequest(xcb_generic_event_t *ev);
 void motionnotify(xcb_generic_event_t *ev);
 void mousemotion(Client *c, xcb_button_t button, int mx, int my);
 void propertynotify(xcb_generic_event_t *ev);
+int settle(void);
 void unmapnotify(xcb_generic_event_t *ev);
@@ -25,7 +25,7 @@
 
 int dwindle(Workspace *ws)
 {
-	Client *c;
+	Client *c, **t;
 	Monitor *m = ws->mon;
 	unsigned int i, n, x, y;
 	int w, h, ww, g, f = 0, ret = 1;
@@ -43,7 +43,7 @@ int dwindle(Workspace *ws)
 	h = m->wh - ws->padt - ws->padb;
 	ww = w;
 
-	for (i = 0, c = nexttiled(ws->clients); c; c = nexttiled(c->next), i++) {
+	for (i = 0, t = tiled(ws); (c = t[i]); i++) {
 		unsigned int ox = x, oy = y;
 		int *p = (i % 2) ? &h : &w;
 		int b = globalcfg[GLB_SMART_BORDER].val && n == 1 ? 0 : c->bw;
@@ -71,13 +71,12 @@ int dwindle(Workspace *ws)
 		}
 		resizehint(c, x + g, y + g, w - g - (2 * b), h - g - (2 * b), b, 0, 0);
 	}
-	xcb_aux_sync(con);
 	return ret;
 }
 
 int grid(Workspace *ws)
 {
-	Client *c;
+	Client *c, **t;
 	Monitor *m = ws->mon;
 	int wx, wy, ww, wh;
 	int i, n, g, cols, rows, col, row;
@@ -100,7 +99,7 @@ int grid(Workspace *ws)
 	else
 		g = ws->gappx, ws->smartgap = 0;
 
-	for (i = col = row = 0, c = nexttiled(ws->clients); c; i++, c = nexttiled(c->next)) {
+	for (i = col = row = 0, t = tiled(ws); (c = t[i]); i++) {
 		if (i / MAX(1, rows) + 1 > cols - n % cols)
 			rows = n / cols + 1;
 		int b = globalcfg[GLB_SMART_BORDER].val && n == 1 ? 0 : c->bw;
@@ -114,13 +113,12 @@ int grid(Workspace *ws)
 			col++;
 		}
 	}
-	xcb_aux_sync(con);
 	return 1;
 }
 
 int ltile(Workspace *ws)
 {
-	Client *c;
+	Client *c, **t;
 	Monitor *m = ws->mon;
 	int i, g, n, x, *y, remain, ret = 0, p = -1, pbw = 0;
 	int mw, my, sw, sy, ss, ssw, ssy, ns = 1;
@@ -152,7 +150,7 @@ int ltile(Workspace *ws)
 	if (!ws->nmaster)
 		ss = 0;
 
-	for (i = 0, my = sy = ssy = g, c = nexttiled(ws->clients); c; c = nexttiled(c->next), ++i) {
+	for (i = 0, my = sy = ssy = g, t = tiled(ws); (c = t[i]); ++i) {
 		if (i < ws->nmaster) {
 			remain = MIN(n, ws->nmaster) - i;
 			x = g;
@@ -217,19 +215,18 @@ update:
 		pbw = bw;
 	}
 
-	for (i = 0, c = nexttiled(ws->clients); c; c = nexttiled(c->next), i++) {
+	for (i = 0, t = tiled(ws); (c = t[i]); i++) {
 		if (geo[i][3] <= globalcfg[GLB_MIN_WH].val) ret = -1; // NOLINT ?
 		resizehint(c, geo[i][0], geo[i][1], geo[i][2], geo[i][3],
 				!globalcfg[GLB_SMART_BORDER].val || n > 1 ? c->bw : 0, 0, 0);
 	}
-	xcb_aux_sync(con);
 	return ret;
 }
 
 int mono(Workspace *ws)
 {
 	int g;
-	Client *c;
+	Client *c, **t;
 
 	if (ws->sel) {
 		if (globalcfg[GLB_SMART_GAP].val)
@@ -239,19 +236,18 @@ int mono(Workspace *ws)
 
 		int b = globalcfg[GLB_SMART_BORDER].val ? 0 : ws->sel->bw;
 
-		for (c = nexttiled(ws->clients); c; c = nexttiled(c->next)) {
+		for (t = tiled(ws); (c = *t); t++) {
 			resizehint(c, ws->mon->wx + ws->padl + g, ws->mon->wy + ws->padt + g,
 					ws->mon->ww - ws->padl - ws->padr - (2 * g) - (2 * b),
 					ws->mon->wh - ws->padt - ws->padb - (2 * g) - (2 * b), b, 0, 0);
 		}
-		xcb_aux_sync(con);
 	}
 	return 1;
 }
 
 int rtile(Workspace *ws)
 {
-	Client *c;
+	Client *c, **t;
 	Monitor *m = ws->mon;
 	int i, g, n, x, *y, remain, ret = 0, p = -1, pbw = 0;
 	int mw, my, sw, sy, ss, ssw, ssy, ns = 1;
@@ -283,7 +279,7 @@ int rtile(Workspace *ws)
 	if (!ws->nmaster)
 		ss = 0;
 
-	for (i = 0, my = sy = ssy = g, c = nexttiled(ws->clients); c; c = nexttiled(c->next), ++i) {
+	for (i = 0, my = sy = ssy = g, t = tiled(ws); (c = t[i]); ++i) {
 		if (i < ws->nmaster) {
 			remain = MIN(n, ws->nmaster) - i;
 			x = sw + ssw + (g / ns);
@@ -351,18 +347,17 @@ update:
 		pbw = bw;
 	}
 
-	for (i = 0, c = nexttiled(ws->clients); c; c = nexttiled(c->next), i++) {
+	for (i = 0, t = tiled(ws); (c = t[i]); i++) {
 		if (geo[i][3] <= globalcfg[GLB_MIN_WH].val) ret = -1; // NOLINT ?
 		resizehint(c, geo[i][0], geo[i][1], geo[i][2], geo[i][3],
 				!globalcfg[GLB_SMART_BORDER].val || n > 1 ? c->bw : 0, 0, 0);
 	}
-	xcb_aux_sync(con);
 	return ret;
 }
 
 int spiral(Workspace *ws)
 {
-	Client *c;
+	Client *c, **t;
 	Monitor *m = ws->mon;
 	unsigned int i, n, x, y;
 	int w, h, ww, g, f = 0, ret = 1;
@@ -380,7 +375,7 @@ int spiral(Workspace *ws)
 	h = m->wh - ws->padt - ws->padb;
 	ww = w;
 
-	for (i = 0, c = nexttiled(ws->clients); c; c = nexttiled(c->next), i++) {
+	for (i = 0, t = tiled(ws); (c = t[i]); i++) {
 		unsigned int ox = x, oy = y;
 		int *p = (i % 2) ? &h : &w;
 		int b = globalcfg[GLB_SMART_BORDER].val && n == 1 ? 0 : c->bw;
@@ -413,6 +408,5 @@ int spiral(Workspace *ws)
 		}
 		resizehint(c, x + g, y + g, w - (2 * b) - g, h - (2 * b) - g, b, 0, 0);
 	}
-	xcb_aux_sync(con);
 	return ret;
 }
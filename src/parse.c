@@ -22,6 +22,7 @@
 #include "util.h"
 #include "cmd.h"
 #include "layout.h"
+#include "perf.h"
 
 
 int parsebool(char *arg)
@@ -84,18 +85,28 @@ static char *parsetoken(char **src)
 
 void parsecmd(char *buf)
 {
+	PerfOp *prev;
 	char **argv, **save, *tok;
-	int n = 0, match = 0, max = 32;
+	int n = 0, match = 0, max = 32, timed = 0;
 	status_usingcmdresp = 0;
 
+	latstamp();
 	save = argv = ecalloc(max, sizeof(char *));
+	memcount(MEM_CMD, 1, max * sizeof(char *));
 	while ((tok = parsetoken(&buf))) {
-		if (n + 1 >= max)
+		if (n + 1 >= max) {
+			memcount(MEM_CMD, 0, max * sizeof(char *));
 			save = argv = erealloc(argv, (max *= 2) * sizeof(char *));
+		}
 		argv[n++] = tok;
 	}
 	argv[n] = NULL;
 
+	if (n && !strcmp("time", *argv)) {
+		/* sent by dkcmd -t, the time spent here is appended to the response */
+		timed = 1;
+		argv++, n--;
+	}
 	if (n) {
 		int j = n;
 		unsigned int i;
@@ -103,7 +114,12 @@ void parsecmd(char *buf)
 			for (i = 0, match = 0; keywords[i].str; i++) {
 				if ((match = !strcmp(keywords[i].str, *argv))) {
 					cmdc = selws->sel;
-					if ((n = keywords[i].func(argv + 1)) == -1) goto end;
+					prev = perfenter(PERF_OP_CMD(i), keywords[i].str);
+					latbegin();
+					trace(TR_CMD, cmdc ? cmdc->win : 0, i);
+					n = keywords[i].func(argv + 1);
+					perfleave(prev);
+					if (n == -1) goto end;
 					argv += ++n, j -= n;
 					break;
 				}
@@ -113,7 +129,9 @@ void parsecmd(char *buf)
 	}
 	if (!match && *argv) respond(cmdresp, "!invalid or unknown command: %s", *argv);
 end:
+	if (timed && !status_usingcmdresp) respond(cmdresp, "\ntime=%lu", latelapsed());
 	if (cmdresp && !status_usingcmdresp) { fflush(cmdresp); fclose(cmdresp); }
+	memcount(MEM_CMD, -1, -(long)(max * sizeof(char *)));
 	free(save);
 }
 
@@ -224,6 +242,10 @@ Workspace *parsewsormon(char *arg, int mon)
 		for (m = nextmon(monitors); m; m = nextmon(m->next))
 			if (!strcmp(m->name, arg)) return m->ws;
 	} else {
+		/* workspaces keep their number as the name unless renamed, check
+		 * the numbered workspace first before searching all of the names */
+		if ((i = parseint(arg, NULL, 0)) != INT_MIN && (ws = itows(i - 1)) && !strcmp(ws->name, arg))
+			return ws;
 		FOR_EACH(ws, workspaces)
 			if (!strcmp(ws->name, arg)) return ws;
 	}
@@ -0,0 +1,218 @@
+/* dk window manager
+ *
+ * see license file for copyright and license details
+ * vim:ft=c:fdm=syntax:ts=4:sts=4:sw=4
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "perf.h"
+
+/* X requests, replies and syncs are counted against whichever event type
+ * or command is being handled, see dispatch() and parsecmd(), anything
+ * outside of those lands in the first entry, see PERF_OP_* for the layout */
+static PerfOp ops[PERF_OPS] = { [0] = { .name = "other" } };
+static const char *countnames[PERF_LAST] = {
+	[PERF_REQUEST] = "requests",
+	[PERF_REPLY]   = "replies",
+	[PERF_SYNC]    = "syncs",
+};
+
+/* the tracer always runs, a record is a clock read and a store, the oldest
+ * records are overwritten and the buffer is only formatted when dumped */
+static Trace traces[TRACE_SIZE];
+static unsigned long ntraces;
+static const char *tracenames[TR_LAST] = {
+	[TR_DISPATCH] = "dispatch", [TR_CMD]     = "cmd",
+	[TR_MANAGE]   = "manage",   [TR_UNMANAGE] = "unmanage",
+	[TR_REFRESH]  = "refresh",  [TR_LAYOUT]  = "layout",
+	[TR_FOCUS]    = "focus",
+};
+
+/* live objects and bytes per subsystem, updated where they're allocated
+ * and freed so anything dropped without being freed shows up here */
+static Mem mems[MEM_LAST], memtotal;
+static const char *memnames[MEM_LAST] = {
+	[MEM_CLIENT] = "client", [MEM_PANEL]  = "panel",
+	[MEM_DESK]   = "desk",   [MEM_RULE]   = "rule",
+	[MEM_REGEX]  = "regex",  [MEM_STATUS] = "status",
+	[MEM_WS]     = "ws",     [MEM_MON]    = "mon",
+	[MEM_CMD]    = "cmd",
+};
+
+/* time from an event coming off the queue or a command arriving until
+ * the requests it made are flushed to the server, see latstamp() */
+static struct { PerfOp *op; uint64_t t0; } pending[LAT_PENDING];
+static unsigned int npending;
+static uint64_t stamp;
+
+PerfOp *perfcur = &ops[0];
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double latpercent(PerfOp *op, double p)
+{
+	unsigned int i;
+	unsigned long n = 0, want = op->latn * p + 0.5;
+	double us = op->latmax / 1000.0;
+
+	for (i = 0; i < LAT_BUCKETS && (n += op->lat[i]) < want; i++)
+		;
+	/* upper edge of the bucket the percentile landed in */
+	return i < LAT_BUCKETS - 1 && (double)(2UL << i) < us ? (double)(2UL << i) : us;
+}
+
+void latbegin(void)
+{
+	if (npending < LAT_PENDING) {
+		pending[npending].op = perfcur;
+		pending[npending++].t0 = stamp;
+	}
+}
+
+unsigned long latelapsed(void)
+{
+	return (now() - stamp) / 1000;
+}
+
+void latend(void)
+{
+	unsigned int i, b;
+	uint64_t t, d;
+
+	if (!npending) return;
+	t = now();
+	for (i = 0; i < npending; i++) {
+		PerfOp *op = pending[i].op;
+		d = t - pending[i].t0;
+		for (b = 0; b < LAT_BUCKETS - 1 && (d / 1000) >> (b + 1); b++)
+			;
+		op->lat[b]++;
+		op->latn++;
+		if (d > op->latmax) op->latmax = d;
+	}
+	npending = 0;
+}
+
+void latprint(FILE *f)
+{
+	fprintf(f, "# name count p50_us p99_us max_us");
+	for (unsigned int i = 0; i < PERF_OPS; i++)
+		if (ops[i].latn)
+			fprintf(f, "\n%s %lu %.0f %.0f %.0f", ops[i].name, ops[i].latn,
+					latpercent(&ops[i], 0.50), latpercent(&ops[i], 0.99), ops[i].latmax / 1000.0);
+}
+
+void latstamp(void)
+{
+	stamp = now();
+}
+
+void memcount(int kind, long objs, long bytes)
+{
+	Mem *m = &mems[kind];
+
+	m->objs += objs;
+	if ((m->bytes += bytes) > m->peak)
+		m->peak = m->bytes;
+	memtotal.objs += objs;
+	if ((memtotal.bytes += bytes) > memtotal.peak)
+		memtotal.peak = memtotal.bytes;
+}
+
+void memprint(FILE *f)
+{
+	fprintf(f, "# name objects bytes peak_bytes");
+	fprintf(f, "\ntotal %ld %ld %ld", memtotal.objs, memtotal.bytes, memtotal.peak);
+	for (unsigned int i = 0; i < MEM_LAST; i++)
+		fprintf(f, "\n%s %ld %ld %ld", memnames[i], mems[i].objs, mems[i].bytes, mems[i].peak);
+}
+
+PerfOp *perfenter(unsigned int id, const char *name)
+{
+	PerfOp *prev = perfcur;
+
+	perfcur = &ops[id < PERF_OPS ? id : 0];
+	if (!perfcur->name) perfcur->name = name;
+	perfcur->runs++;
+	return prev;
+}
+
+void perfleave(PerfOp *prev)
+{
+	perfcur = prev;
+}
+
+void perfprint(FILE *f)
+{
+	unsigned int i, j;
+	unsigned long runs = 0, total[PERF_LAST] = { 0 };
+
+	for (i = 0; i < PERF_OPS; i++) {
+		runs += ops[i].runs;
+		for (j = 0; j < PERF_LAST; j++)
+			total[j] += ops[i].count[j];
+	}
+	fprintf(f, "# name runs");
+	for (j = 0; j < PERF_LAST; j++)
+		fprintf(f, " %s", countnames[j]);
+	for (j = 0; j < PERF_LAST; j++)
+		fprintf(f, " avg_%s", countnames[j]);
+	fprintf(f, "\ntotal %lu", runs);
+	for (j = 0; j < PERF_LAST; j++)
+		fprintf(f, " %lu", total[j]);
+	for (j = 0; j < PERF_LAST; j++)
+		fprintf(f, " %.2f", runs ? (double)total[j] / runs : 0.0);
+	for (i = 0; i < PERF_OPS; i++) {
+		for (j = 0, runs = ops[i].runs; j < PERF_LAST; j++)
+			runs += ops[i].count[j];
+		if (!runs) continue;
+		fprintf(f, "\n%s %lu", ops[i].name, ops[i].runs);
+		for (j = 0; j < PERF_LAST; j++)
+			fprintf(f, " %lu", ops[i].count[j]);
+		for (j = 0; j < PERF_LAST; j++)
+			fprintf(f, " %.2f", ops[i].runs ? (double)ops[i].count[j] / ops[i].runs : 0.0);
+	}
+}
+
+void perfreset(void)
+{
+	for (unsigned int i = 0; i < PERF_OPS; i++) {
+		ops[i].runs = ops[i].latn = 0;
+		ops[i].latmax = 0;
+		memset(ops[i].count, 0, sizeof(ops[i].count));
+		memset(ops[i].lat, 0, sizeof(ops[i].lat));
+	}
+}
+
+void trace(uint8_t id, uint32_t win, uint32_t arg)
+{
+	Trace *t = &traces[ntraces++ & (TRACE_SIZE - 1)];
+
+	t->ns = now();
+	t->id = id;
+	t->win = win;
+	t->arg = arg;
+}
+
+void traceprint(FILE *f)
+{
+	Trace *t;
+	unsigned long i = ntraces > TRACE_SIZE ? ntraces - TRACE_SIZE : 0;
+
+	fprintf(f, "# seconds event window arg");
+	for (; i < ntraces; i++) {
+		t = &traces[i & (TRACE_SIZE - 1)];
+		fprintf(f, "\n%llu.%09llu %s 0x%08x %u",
+				(unsigned long long)(t->ns / 1000000000), (unsigned long long)(t->ns % 1000000000),
+				t->id < TR_LAST ? tracenames[t->id] : "unknown", t->win, t->arg);
+	}
+}
@@ -0,0 +1,92 @@
+/* dk window manager
+ *
+ * see license file for copyright and license details
+ * vim:ft=c:fdm=syntax:ts=4:sts=4:sw=4
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PERF(counter)       (perfcur->count[(counter)]++)
+#define PERFN(counter, n)   (perfcur->count[(counter)] += (n))
+
+/* perfenter() ids, one slot per event type (response_type & 0x7f) and per
+ * keyword index so entering an op never has to search for it */
+#define PERF_OP_REFRESH     1
+#define PERF_OP_EVENT(type) (2 + (type))
+#define PERF_OP_CMD(idx)    (PERF_OP_EVENT(128) + (idx))
+#define PERF_OPS            PERF_OP_CMD(64)
+#define TRACE_SIZE          4096 /* records kept, a power of two */
+#define LAT_BUCKETS         24   /* bucket 0 holds [0, 2), bucket n [2^n, 2^(n+1)) microseconds */
+#define LAT_PENDING         512  /* samples waiting on the next flush */
+
+enum PerfCounter {
+	PERF_REQUEST = 0,
+	PERF_REPLY   = 1,
+	PERF_SYNC    = 2,
+	PERF_LAST    = 3,
+};
+
+enum MemKind {
+	MEM_CLIENT = 0,
+	MEM_PANEL  = 1,
+	MEM_DESK   = 2,
+	MEM_RULE   = 3, /* rule strings are counted here */
+	MEM_REGEX  = 4, /* compiled patterns, estimated by MEM_REGEXSZ() */
+	MEM_STATUS = 5,
+	MEM_WS     = 6,
+	MEM_MON    = 7,
+	MEM_CMD    = 8, /* parsecmd() argv, only the peak is kept between commands */
+	MEM_LAST   = 9,
+};
+
+/* libc owns the compiled buffers and won't say how big they are, this is a
+ * rough guess from the pattern length, counted and released the same way */
+#define MEM_REGEXSZ(pat) ((long)(sizeof(regex_t) + 64 * strlen(pat)))
+
+enum TraceEvent {
+	TR_DISPATCH = 0, /* arg is the event type */
+	TR_CMD      = 1, /* arg is the keyword index */
+	TR_MANAGE   = 2, /* arg is 1 during the startup scan */
+	TR_UNMANAGE = 3, /* arg is 1 for destroyed windows */
+	TR_REFRESH  = 4,
+	TR_LAYOUT   = 5, /* arg is the workspace number */
+	TR_FOCUS    = 6,
+	TR_LAST     = 7,
+};
+
+typedef struct Trace {
+	uint64_t ns;
+	uint32_t win, arg;
+	uint8_t id;
+} Trace;
+
+typedef struct Mem {
+	long objs, bytes, peak;
+} Mem;
+
+typedef struct PerfOp {
+	const char *name;        /* event label or command keyword, never freed */
+	unsigned long runs;
+	unsigned long count[PERF_LAST];
+	unsigned long lat[LAT_BUCKETS], latn;
+	uint64_t latmax;         /* nanoseconds */
+} PerfOp;
+
+extern PerfOp *perfcur;
+
+void latbegin(void);
+unsigned long latelapsed(void);
+void latend(void);
+void latprint(FILE *f);
+void latstamp(void);
+void memcount(int kind, long objs, long bytes);
+void memprint(FILE *f);
+PerfOp *perfenter(unsigned int id, const char *name);
+void perfleave(PerfOp *prev);
+void perfprint(FILE *f);
+void perfreset(void);
+void trace(uint8_t id, uint32_t win, uint32_t arg);
+void traceprint(FILE *f);
@@ -6,14 +6,101 @@
 
 #include <sys/wait.h>
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdarg.h>
 #include <signal.h>
 #include <err.h>
 
 #include "util.h"
 
+/* slab objects are kept aligned for any type, the first word of a
+ * free object links to the next free one, the first (padded) word
+ * of a slab links to the previously allocated slab */
+#define POOLALIGN     (sizeof(max_align_t))
+#define POOLOBJ(sz, a) ((((sz) < sizeof(void *) ? sizeof(void *) : (sz)) + (a) - 1) & ~((a) - 1))
+
+/* interned strings are shared and refcounted, two interned strings are
+ * equal exactly when their pointers are, the string is stored inline
+ * after the header so the header is found from the string pointer */
+typedef struct IStr {
+	struct IStr *next;
+	unsigned int ref;
+	char str[];
+} IStr;
+
+#define ISTRBUCKETS   128
+#define ISTR(s)       ((IStr *)((char *)(s) - offsetof(IStr, str)))
+
+static IStr *istrs[ISTRBUCKETS];
+
+/* arena strings are bumped out of aligned chunks, a chunk keeps count of
+ * the bytes still in use and is freed once that drops to zero, strings
+ * longer than a chunk get one of their own, masking a string's address
+ * finds its chunk header */
+typedef struct Chunk {
+	size_t used, live;
+} Chunk;
+
+#define ARENACHUNK(a)  ((a)->chunk ? (a)->chunk : 4096)
+#define CHUNK(a, s)    ((Chunk *)((uintptr_t)(s) & ~(uintptr_t)(ARENACHUNK(a) - 1)))
+
+static Chunk *arenachunk(Arena *a, size_t need)
+{
+	Chunk *h;
+	size_t sz = ARENACHUNK(a);
+
+	sz = (need + sz - 1) & ~(sz - 1);
+	if (UNLIKELY((h = aligned_alloc(ARENACHUNK(a), sz)) == NULL))
+		err(1, "unable to allocate space");
+	h->used = sizeof(Chunk);
+	h->live = 0;
+	return h;
+}
+
+void arenadestroy(Arena *a)
+{
+	/* only the current chunk can be left once every string is freed */
+	free(a->cur);
+	a->cur = NULL;
+}
+
+void arenafree(Arena *a, char *s, size_t size)
+{
+	Chunk *h;
+
+	if (!s) return;
+	h = CHUNK(a, s);
+	if (!(h->live -= size)) {
+		if (h == a->cur)
+			h->used = sizeof(Chunk);
+		else
+			free(h);
+	}
+}
+
+char *arenastr(Arena *a, const char *s, size_t len)
+{
+	char *p;
+	Chunk *h = a->cur;
+	size_t n = len + 1;
+
+	if (n > ARENACHUNK(a) - sizeof(Chunk)) {
+		h = arenachunk(a, sizeof(Chunk) + n);
+	} else if (!h || h->used + n > ARENACHUNK(a)) {
+		if (h && !h->live) free(h);
+		h = a->cur = arenachunk(a, ARENACHUNK(a));
+	}
+	p = (char *)h + h->used;
+	h->used += n;
+	h->live += n;
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
 void check(int i, char *msg)
 {
 	if (i < 0)
@@ -56,6 +143,145 @@ char *itoa(int n, char *s)
 	return s;
 }
 
+static unsigned int maphash(uint32_t key, unsigned int mask)
+{
+	key ^= key >> 16;
+	key *= 0x45d9f3b;
+	key ^= key >> 16;
+	return key & mask;
+}
+
+static void mapgrow(Map *m)
+{
+	unsigned int i, n = m->size;
+	MapEnt *old = m->ents;
+
+	m->used = 0;
+	m->size = n ? n * 2 : 64;
+	m->ents = ecalloc(m->size, sizeof(MapEnt));
+	for (i = 0; i < n; i++)
+		if (old[i].key) mapset(m, old[i].key, old[i].tag, old[i].val);
+	free(old);
+}
+
+void mapdel(Map *m, uint32_t key)
+{
+	unsigned int i, j, k, mask;
+
+	if (!m->size || !key) return;
+	mask = m->size - 1;
+	for (i = maphash(key, mask); m->ents[i].key != key; i = (i + 1) & mask)
+		if (!m->ents[i].key) return;
+
+	/* linear probing with backward shift deletion, entries further along the
+	 * chain are moved into the hole unless their home slot lies between the
+	 * hole and where they sit now, this keeps lookups free of tombstones */
+	for (j = i;;) {
+		m->ents[i].key = 0;
+		do {
+			j = (j + 1) & mask;
+			if (!m->ents[j].key) {
+				m->used--;
+				return;
+			}
+			k = maphash(m->ents[j].key, mask);
+		} while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+		m->ents[i] = m->ents[j];
+		i = j;
+	}
+}
+
+void mapfree(Map *m)
+{
+	free(m->ents);
+	m->ents = NULL;
+	m->size = m->used = 0;
+}
+
+MapEnt *mapget(Map *m, uint32_t key)
+{
+	unsigned int i, mask;
+
+	if (!m->size || !key) return NULL;
+	mask = m->size - 1;
+	for (i = maphash(key, mask); m->ents[i].key; i = (i + 1) & mask)
+		if (m->ents[i].key == key) return &m->ents[i];
+	return NULL;
+}
+
+void mapset(Map *m, uint32_t key, int tag, void *val)
+{
+	unsigned int i, mask;
+
+	if (!key) return;
+	if ((m->used + 1) * 2 > m->size) mapgrow(m);
+	mask = m->size - 1;
+	for (i = maphash(key, mask); m->ents[i].key && m->ents[i].key != key; i = (i + 1) & mask)
+		;
+	if (!m->ents[i].key) m->used++;
+	m->ents[i].key = key;
+	m->ents[i].tag = tag;
+	m->ents[i].val = val;
+}
+
+static void poolslab(Pool *p)
+{
+	char *slab, *base, *o;
+	size_t a = p->align > POOLALIGN ? p->align : POOLALIGN;
+	size_t sz = POOLOBJ(p->size, a);
+	unsigned int i, n = p->nslab ? p->nslab : 16;
+
+	/* the allocation is only max_align_t aligned, a larger alignment is
+	 * made up for by skipping ahead to the first aligned address */
+	slab = ecalloc(1, a + (n * sz));
+	*(void **)slab = p->slabs;
+	p->slabs = slab;
+	base = (char *)(((uintptr_t)slab + POOLALIGN + a - 1) & ~(uintptr_t)(a - 1));
+	for (i = n; i > 0; i--) { /* push backwards so objects are handed out in address order */
+		o = base + ((i - 1) * sz);
+		*(void **)o = p->freelist;
+		p->freelist = o;
+	}
+	p->free += n;
+}
+
+void poolfree(Pool *p)
+{
+	void *slab, *next;
+
+	for (slab = p->slabs; slab; slab = next) {
+		next = *(void **)slab;
+		free(slab);
+	}
+	p->slabs = p->freelist = NULL;
+	p->live = p->free = 0;
+}
+
+void *poolget(Pool *p)
+{
+	void *o;
+
+	if (!p->freelist) poolslab(p);
+	o = p->freelist;
+	p->freelist = *(void **)o;
+	p->free--, p->live++;
+	memset(o, 0, p->size);
+	return o;
+}
+
+void poolgrow(Pool *p, unsigned int n)
+{
+	while (p->free < n) poolslab(p);
+}
+
+void poolput(Pool *p, void *ptr)
+{
+	if (!ptr) return;
+	*(void **)ptr = p->freelist;
+	p->freelist = ptr;
+	p->free++, p->live--;
+}
+
 void respond(FILE *f, const char *fmt, ...)
 {
 	va_list ap;
@@ -87,6 +313,50 @@ void sighandle(int sig)
 	}
 }
 
+static IStr **strbucket(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+	return &istrs[h & (ISTRBUCKETS - 1)];
+}
+
+const char *strintern(const char *s)
+{
+	IStr *i, **b = strbucket(s);
+	size_t len;
+
+	for (i = *b; i; i = i->next)
+		if (!strcmp(i->str, s)) {
+			i->ref++;
+			return i->str;
+		}
+	len = strlen(s) + 1;
+	i = ecalloc(1, sizeof(IStr) + len);
+	memcpy(i->str, s, len);
+	i->ref = 1;
+	i->next = *b;
+	*b = i;
+	return i->str;
+}
+
+void strrelease(const char *s)
+{
+	IStr *i, **b;
+
+	if (!s || --(i = ISTR(s))->ref) return;
+	for (b = strbucket(s); *b != i; b = &(*b)->next)
+		;
+	*b = i->next;
+	free(i);
+}
+
+const char *strretain(const char *s)
+{
+	if (s) ISTR(s)->ref++;
+	return s;
+}
+
 int usage(char *prog, char *ver, int e, char flag, char *flagstr)
 {
 	switch (flag) {
@@ -6,12 +6,52 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #define UNLIKELY(x)     __builtin_expect(!!(x), 0)
 
+typedef struct Arena {
+	size_t chunk;               /* chunk size and alignment, a power of two, 4096 when unset */
+	void *cur;                  /* chunk strings are bumped out of */
+} Arena;
+
+typedef struct MapEnt {
+	uint32_t key;
+	int tag;
+	void *val;
+} MapEnt;
+
+typedef struct Map {
+	unsigned int size, used;
+	MapEnt *ents;
+} Map;
+
+typedef struct Pool {
+	size_t size;                /* object size */
+	size_t align;               /* object alignment, a power of two, max_align_t when unset */
+	unsigned int nslab;         /* objects per slab, 16 when unset */
+	unsigned int live, free;    /* objects handed out and sitting on the free list */
+	void *freelist, *slabs;
+} Pool;
+
+void arenadestroy(Arena *a);
+void arenafree(Arena *a, char *s, size_t size);
+char *arenastr(Arena *a, const char *s, size_t len);
 void check(int i, char *msg);
 void *ecalloc(size_t elems, size_t elemsize);
 void *erealloc(void *p, size_t size);
 char *itoa(int n, char *s);
+void mapdel(Map *m, uint32_t key);
+void mapfree(Map *m);
+MapEnt *mapget(Map *m, uint32_t key);
+void mapset(Map *m, uint32_t key, int tag, void *val);
+void poolfree(Pool *p);
+void *poolget(Pool *p);
+void poolgrow(Pool *p, unsigned int n);
+void poolput(Pool *p, void *ptr);
 void respond(FILE *f, const char *fmt, ...);
 void sighandle(int sig);
+const char *strintern(const char *s);
+void strrelease(const char *s);
+const char *strretain(const char *s);
 int usage(char *prog, char *ver, int e, char flag, char *flagstr);